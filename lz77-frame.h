@@ -0,0 +1,391 @@
+#ifndef LZ77_FRAME_H
+#define LZ77_FRAME_H
+
+/**
+ * @file lz77-frame.h
+ * @brief Streaming frame format for LZ77 blocks over pipes and sockets
+ *
+ * A stream is a sequence of self-delimiting frames, each carrying one block
+ * of at most LZ77_FRAME_BLOCK_SIZE bytes:
+ *
+ *   [payload length:24 | flags:8][raw length:32][checksum:32, optional]
+ *   [payload]
+ *
+ * All fields are little-endian. The payload is an lz77_compress() block when
+ * LZ77_FRAME_COMPRESSED is set and the raw bytes otherwise (data that does not
+ * compress is sent as is). LZ77_FRAME_CHECKSUM adds the Adler-32 of the raw
+ * bytes. LZ77_FRAME_FLUSH marks a flush point: the receiver has everything
+ * the sender wrote up to it, and may act on a complete message.
+ *
+ * Frames are independent unless the writer is set up with LZ77_FRAME_LINKED.
+ * A linked writer compresses the whole stream with one lz77_stream context and
+ * marks its frames LZ77_FRAME_LINKED: their payloads may refer back up to
+ * MAX_DISTANCE bytes into earlier linked frames. A flush then ends the current
+ * block without dropping the history, so small messages sent one per flush
+ * still compress against the messages before them. The reader keeps the same
+ * history and decodes linked and independent frames alike.
+ *
+ * The writer buffers data and emits a frame whenever a block fills up or the
+ * caller flushes; the reader accepts bytes in pieces of any size, as they come
+ * from read(), and hands out each frame as soon as it is complete. Neither
+ * allocates memory: both keep their buffers in the caller-provided context.
+ *
+ * Like lz77.h, this header defines its functions and must be included by a
+ * single translation unit.
+ *
+ * Usage Example:
+ * @code
+ *   static int send_bytes(void *ctx, const void *buf, size_t len)
+ *   {
+ *       return write(*(int *) ctx, buf, len) == (ssize_t) len ? 0 : -1;
+ *   }
+ *
+ *   static struct lz77_frame_writer writer;
+ *   lz77_frame_writer_init(&writer, LZ77_FRAME_CHECKSUM | LZ77_FRAME_LINKED,
+ *                          send_bytes, &fd);
+ *   lz77_frame_write(&writer, request, request_len);
+ *   lz77_frame_flush(&writer);
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz77.h"
+
+/* Largest block carried by one frame; both ends must agree on it */
+#ifndef LZ77_FRAME_BLOCK_SIZE
+#define LZ77_FRAME_BLOCK_SIZE (64 * 1024)
+#endif
+
+#define LZ77_FRAME_HEADER_SIZE 8
+#define LZ77_FRAME_CHECKSUM_SIZE 4
+
+/* Worst-case size of an lz77_compress() block of n bytes */
+#define LZ77_FRAME_BOUND(n) ((n) + (n) / 32 + COMPRESS_OVERHEAD)
+
+/* Largest frame on the wire, header and checksum included */
+#define LZ77_FRAME_MAX_SIZE                         \
+    (LZ77_FRAME_HEADER_SIZE + LZ77_FRAME_CHECKSUM_SIZE + \
+     LZ77_FRAME_BOUND(LZ77_FRAME_BLOCK_SIZE))
+
+/* Writer and reader buffers: the linked history plus room for two blocks, so
+ * the history only slides to the front once per block
+ */
+#define LZ77_FRAME_WINDOW (MAX_DISTANCE + 2 * LZ77_FRAME_BLOCK_SIZE)
+
+#if LZ77_FRAME_BOUND(LZ77_FRAME_BLOCK_SIZE) >= (1 << 24)
+#error "LZ77_FRAME_BLOCK_SIZE does not fit the 24-bit payload length"
+#endif
+
+/* Frame flags */
+#define LZ77_FRAME_COMPRESSED 0x01 /* payload is an lz77_compress() block */
+#define LZ77_FRAME_CHECKSUM 0x02   /* Adler-32 of the raw bytes follows */
+#define LZ77_FRAME_FLUSH 0x04      /* flush point after this frame */
+#define LZ77_FRAME_LINKED 0x08     /* payload may refer to earlier frames */
+#define LZ77_FRAME_FLAGS                                                 \
+    (LZ77_FRAME_COMPRESSED | LZ77_FRAME_CHECKSUM | LZ77_FRAME_FLUSH | \
+     LZ77_FRAME_LINKED)
+
+/* Error codes; the first error is sticky */
+#define LZ77_FRAME_OK 0
+#define LZ77_FRAME_EIO (-1)       /* write or deliver callback failed */
+#define LZ77_FRAME_ECORRUPT (-2)  /* malformed frame */
+#define LZ77_FRAME_ECHECKSUM (-3) /* checksum mismatch */
+
+/* Sends len bytes; returns 0 on success */
+typedef int (*lz77_frame_write_fn)(void *ctx, const void *buf, size_t len);
+
+/* Receives the raw bytes of one frame; flush is nonzero at a flush point.
+ * Returns 0 to continue.
+ */
+typedef int (*lz77_frame_data_fn)(void *ctx,
+                                  const void *buf,
+                                  size_t len,
+                                  int flush);
+
+struct lz77_frame_writer {
+    lz77_frame_write_fn write;
+    void *ctx;
+    unsigned options; /* LZ77_FRAME_CHECKSUM and LZ77_FRAME_LINKED */
+    int error;
+    size_t start, end; /* buffered bytes are raw[start, end), history before */
+    uint8_t raw[LZ77_FRAME_WINDOW];
+    uint8_t frame[LZ77_FRAME_MAX_SIZE];
+    struct lz77_stream stream;
+};
+
+struct lz77_frame_reader {
+    lz77_frame_data_fn deliver;
+    void *ctx;
+    int error;
+    size_t have, need; /* bytes of the current frame buffered and expected */
+    size_t end;        /* linked data decoded into raw, history included */
+    uint8_t frame[LZ77_FRAME_MAX_SIZE];
+    uint8_t raw[LZ77_FRAME_WINDOW];
+};
+
+/* Adler-32 checksum (RFC 1950 Section 8.2) */
+static inline uint32_t lz77_frame_adler32(const void *buf, size_t len)
+{
+    const uint8_t *ptr = (const uint8_t *) buf;
+    uint32_t s1 = 1, s2 = 0;
+
+    /* Process in chunks to defer modulo operations */
+    while (len > 0) {
+        size_t k = len < 5552 ? len : 5552;
+        len -= k;
+        while (k--)
+            s2 += (s1 += *ptr++);
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+
+    return (s2 << 16) | s1;
+}
+
+static inline void lz77_frame_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 255;
+    p[1] = (v >> 8) & 255;
+    p[2] = (v >> 16) & 255;
+    p[3] = v >> 24;
+}
+
+static inline uint32_t lz77_frame_get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+ * Prepare a writer sending its frames through the write callback.
+ *
+ * @param w       Writer context (about 240 KiB; allocate it statically or
+ *                on the heap)
+ * @param options LZ77_FRAME_CHECKSUM to add an Adler-32 checksum to every
+ *                frame, LZ77_FRAME_LINKED to compress across frames
+ * @param write   Callback sending the bytes of a complete frame
+ * @param ctx     Opaque pointer passed to write
+ */
+void lz77_frame_writer_init(struct lz77_frame_writer *w,
+                           unsigned options,
+                           lz77_frame_write_fn write,
+                           void *ctx)
+{
+    w->write = write;
+    w->ctx = ctx;
+    w->options = options & (LZ77_FRAME_CHECKSUM | LZ77_FRAME_LINKED);
+    w->error = LZ77_FRAME_OK;
+    w->start = w->end = 0;
+    lz77_stream_init(&w->stream);
+}
+
+/* Compress the buffered bytes into one frame and send it */
+static int lz77_frame_emit(struct lz77_frame_writer *w, uint8_t flags)
+{
+    const uint8_t *data = w->raw + w->start;
+    size_t len = w->end - w->start;
+    size_t header = LZ77_FRAME_HEADER_SIZE + ((w->options & LZ77_FRAME_CHECKSUM)
+                                                  ? LZ77_FRAME_CHECKSUM_SIZE
+                                                  : 0);
+    uint8_t *payload = w->frame + header;
+    size_t size;
+
+    /* A linked block always enters the stream history, even when it is sent
+     * stored: the reader keeps the raw bytes of every linked frame.
+     */
+    if (w->options & LZ77_FRAME_LINKED)
+        size = lz77_compress_continue(&w->stream, data, len, payload);
+    else
+        size = (size_t) lz77_compress(data, (int) len, payload, w->stream.htab);
+
+    /* send data that does not compress as is */
+    if (size > 0 && size < len) {
+        flags |= LZ77_FRAME_COMPRESSED;
+    } else {
+        memcpy(payload, data, len);
+        size = len;
+    }
+
+    flags |= w->options;
+    if (w->options & LZ77_FRAME_CHECKSUM)
+        lz77_frame_put32(w->frame + LZ77_FRAME_HEADER_SIZE,
+                         lz77_frame_adler32(data, len));
+    lz77_frame_put32(w->frame, (uint32_t) size | ((uint32_t) flags << 24));
+    lz77_frame_put32(w->frame + 4, (uint32_t) len);
+
+    /* independent frames need no history */
+    if (w->options & LZ77_FRAME_LINKED)
+        w->start = w->end;
+    else
+        w->start = w->end = 0;
+    if (w->write(w->ctx, w->frame, header + size) != 0)
+        w->error = LZ77_FRAME_EIO;
+    return w->error;
+}
+
+/**
+ * Append data to the stream. Full blocks are sent right away, the rest stays
+ * buffered until more data arrives or lz77_frame_flush() is called.
+ *
+ * @return LZ77_FRAME_OK, or LZ77_FRAME_EIO once the write callback failed
+ */
+int lz77_frame_write(struct lz77_frame_writer *w, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) data;
+
+    while (len > 0 && w->error == LZ77_FRAME_OK) {
+        /* out of room: keep the history and the buffered bytes only */
+        if (w->end == LZ77_FRAME_WINDOW) {
+            size_t keep = w->start < MAX_DISTANCE ? w->start : MAX_DISTANCE;
+            memmove(w->raw, w->raw + w->start - keep, w->end - w->start + keep);
+            w->end -= w->start - keep;
+            w->start = keep;
+        }
+
+        size_t room = LZ77_FRAME_BLOCK_SIZE - (w->end - w->start);
+        if (room > LZ77_FRAME_WINDOW - w->end)
+            room = LZ77_FRAME_WINDOW - w->end;
+        size_t n = len < room ? len : room;
+        memcpy(w->raw + w->end, p, n);
+        w->end += n;
+        p += n, len -= n;
+        if (w->end - w->start == LZ77_FRAME_BLOCK_SIZE)
+            lz77_frame_emit(w, 0);
+    }
+    return w->error;
+}
+
+/**
+ * Send everything written so far, ending with a flush point. A flush with
+ * nothing buffered sends an empty frame, so the receiver always sees the
+ * flush point.
+ */
+int lz77_frame_flush(struct lz77_frame_writer *w)
+{
+    if (w->error != LZ77_FRAME_OK)
+        return w->error;
+    return lz77_frame_emit(w, LZ77_FRAME_FLUSH);
+}
+
+/**
+ * Prepare a reader handing decoded frames to the deliver callback.
+ *
+ * @param r       Reader context (about 200 KiB)
+ * @param deliver Callback receiving the raw bytes of each frame
+ * @param ctx     Opaque pointer passed to deliver
+ */
+void lz77_frame_reader_init(struct lz77_frame_reader *r,
+                           lz77_frame_data_fn deliver,
+                           void *ctx)
+{
+    r->deliver = deliver;
+    r->ctx = ctx;
+    r->error = LZ77_FRAME_OK;
+    r->have = 0;
+    r->need = LZ77_FRAME_HEADER_SIZE;
+    r->end = 0;
+}
+
+/* Validate a frame header; returns the total frame size, or 0 if invalid */
+static size_t lz77_frame_size(const uint8_t *header)
+{
+    uint32_t word = lz77_frame_get32(header);
+    uint32_t payload = word & 0xffffff, raw = lz77_frame_get32(header + 4);
+    uint8_t flags = word >> 24;
+
+    if ((flags & ~LZ77_FRAME_FLAGS) || raw > LZ77_FRAME_BLOCK_SIZE)
+        return 0;
+    if (flags & LZ77_FRAME_COMPRESSED) {
+        if (!payload || payload > LZ77_FRAME_BOUND(raw))
+            return 0;
+    } else if (payload != raw) {
+        return 0;
+    }
+
+    return LZ77_FRAME_HEADER_SIZE +
+           ((flags & LZ77_FRAME_CHECKSUM) ? LZ77_FRAME_CHECKSUM_SIZE : 0) +
+           payload;
+}
+
+/* Decode the complete frame in r->frame and deliver it */
+static int lz77_frame_decode(struct lz77_frame_reader *r)
+{
+    uint32_t word = lz77_frame_get32(r->frame);
+    uint32_t payload = word & 0xffffff, raw = lz77_frame_get32(r->frame + 4);
+    uint8_t flags = word >> 24;
+    const uint8_t *data = r->frame + LZ77_FRAME_HEADER_SIZE;
+
+    if (flags & LZ77_FRAME_CHECKSUM)
+        data += LZ77_FRAME_CHECKSUM_SIZE;
+
+    if (flags & LZ77_FRAME_LINKED) {
+        /* decode right after the history, sliding it to the front first */
+        if (r->end + raw > LZ77_FRAME_WINDOW) {
+            memmove(r->raw, r->raw + r->end - MAX_DISTANCE, MAX_DISTANCE);
+            r->end = MAX_DISTANCE;
+        }
+        uint8_t *out = r->raw + r->end;
+        size_t history = r->end < MAX_DISTANCE ? r->end : MAX_DISTANCE;
+        if (!(flags & LZ77_FRAME_COMPRESSED))
+            memcpy(out, data, raw);
+        else if (lz77_decompress_continue(data, payload, out, raw, history) !=
+                 raw)
+            return LZ77_FRAME_ECORRUPT;
+        r->end += raw;
+        data = out;
+    } else if (flags & LZ77_FRAME_COMPRESSED) {
+        if (lz77_decompress(data, (int) payload, r->raw, (int) raw) !=
+            (int) raw)
+            return LZ77_FRAME_ECORRUPT;
+        data = r->raw;
+    }
+    if ((flags & LZ77_FRAME_CHECKSUM) &&
+        lz77_frame_adler32(data, raw) !=
+            lz77_frame_get32(r->frame + LZ77_FRAME_HEADER_SIZE))
+        return LZ77_FRAME_ECHECKSUM;
+
+    if ((raw || (flags & LZ77_FRAME_FLUSH)) &&
+        r->deliver(r->ctx, data, raw, !!(flags & LZ77_FRAME_FLUSH)) != 0)
+        return LZ77_FRAME_EIO;
+    return LZ77_FRAME_OK;
+}
+
+/**
+ * Feed received bytes to the reader. Every frame completed by them is
+ * decoded and delivered before this function returns; a partial frame is
+ * kept for the next call.
+ *
+ * @return LZ77_FRAME_OK, or the first error met by this reader
+ */
+int lz77_frame_feed(struct lz77_frame_reader *r, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) data;
+
+    while (len > 0 && r->error == LZ77_FRAME_OK) {
+        size_t n = r->need - r->have < len ? r->need - r->have : len;
+        memcpy(r->frame + r->have, p, n);
+        r->have += n;
+        p += n, len -= n;
+        if (r->have < r->need)
+            break;
+
+        if (r->need == LZ77_FRAME_HEADER_SIZE) {
+            r->need = lz77_frame_size(r->frame);
+            if (!r->need) {
+                r->error = LZ77_FRAME_ECORRUPT;
+                break;
+            }
+            if (r->have < r->need)
+                continue;
+        }
+
+        r->error = lz77_frame_decode(r);
+        r->have = 0;
+        r->need = LZ77_FRAME_HEADER_SIZE;
+    }
+    return r->error;
+}
+
+#endif /* LZ77_FRAME_H */
@@ -13,9 +13,9 @@
  * - Cache-friendly hash table design
  *
  * Constraints:
- * - Maximum input size: ~4 GiB (limited by uint32_t position storage)
- * - Files larger than 4 GiB may cause position wraparound and compression
- *   failure
+ * - lz77_compress() takes one block of up to 2 GiB (int length)
+ * - Streams compressed with lz77_compress_continue() have no length limit:
+ *   their 32-bit positions are rebased before they can wrap around
  *
  * Usage Example:
  * @code
@@ -56,7 +56,9 @@
 #define LZ77_WORKMEM_SIZE (HASH_SIZE * sizeof(uint32_t))
 
 /* Compile-time constraint validation */
-/* Position storage uses uint32_t, limiting input size to ~4 GiB */
+/* Position storage uses uint32_t; streams rebase positions to stay below
+ * 4 GiB
+ */
 /* This assertion ensures the hash table design is consistent with this limit */
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
 _Static_assert(sizeof(uint32_t) == 4,
@@ -66,9 +68,46 @@ _Static_assert(sizeof(uint32_t) == 4,
 #if defined(__clang__) || defined(__GNUC__)
 #define LZ77_LIKELY(x) __builtin_expect(!!(x), 1)
 #define LZ77_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define LZ77_INLINE inline __attribute__((always_inline))
 #else
 #define LZ77_LIKELY(x) (x)
 #define LZ77_UNLIKELY(x) (x)
+#define LZ77_INLINE inline
+#endif
+
+/* USDT probes for bpftrace and SystemTap, provider "lz77":
+ *   compress__start(in, length)       compress__end(length, compressed)
+ *   decompress__start(in, length)     decompress__end(length, decompressed)
+ * They are built only with LZ77_USDT defined and <sys/sdt.h> available
+ * (systemtap-sdt-dev); a probe that nothing is attached to is a single nop.
+ * Without them the macros expand to nothing. LZ77_HAVE_USDT tells users of
+ * this header whether DTRACE_PROBEn() can be used for their own probes.
+ */
+#if defined(LZ77_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LZ77_HAVE_USDT 1
+#define LZ77_PROBE2(name, a, b) DTRACE_PROBE2(lz77, name, a, b)
+#endif
+#endif
+#ifndef LZ77_HAVE_USDT
+#define LZ77_HAVE_USDT 0
+#define LZ77_PROBE2(name, a, b) ((void) 0)
+#endif
+
+/* Work counters for worst-case analysis (tests/fuzz-perf.c). A user defining
+ * LZ77_WORK(counter, n) before including this header is told how much work
+ * each call does:
+ *   scan    bytes compared while extending a match, one per match_len() step
+ *   probe   hash table lookups of the compressor
+ *   token   tokens decoded
+ *   copy    memcpy() calls of the decoder, a match copying in chunks of at
+ *           most its distance
+ *   output  bytes written by the decoder, also when it then fails
+ * By default the counters compile to nothing.
+ */
+#ifndef LZ77_WORK
+#define LZ77_WORK(counter, n) ((void) 0)
 #endif
 
 /**
@@ -107,6 +146,7 @@ static uint32_t match_len(const uint8_t *ref_ptr,
     const uint8_t *const start = ref_ptr;
     while (LZ77_LIKELY(ip_ptr < ip_end) && *ref_ptr == *ip_ptr)
         ++ref_ptr, ++ip_ptr;
+    LZ77_WORK(scan, ref_ptr - start + 1);
     return (uint32_t) (ref_ptr - start);
 }
 
@@ -159,60 +199,151 @@ static uint8_t *literals(uint32_t runs, const uint8_t *src, uint8_t *dest)
     return dest;
 }
 
+#ifdef LZ77_ENABLE_STATS
+/* Histogram buckets: bucket i counts values in [2^i, 2^(i+1)), the last one
+ * everything above
+ */
+#define LZ77_STATS_BUCKETS 16
+
 /**
- * Compresses a block of data using the LZ77 algorithm with lazy matching.
- *
- * This function implements LZ77 compression with the following optimizations:
- * - Hash-based dictionary lookup (8192-entry table)
- * - Lazy matching for improved compression ratios
- * - Cache-friendly memory access patterns
- *
- * @param in      Pointer to the input data buffer
- * @param length  Length of input data in bytes (can be 0)
- * @param out     Pointer to output buffer for compressed data
- *                (must be large enough: input_size + COMPRESS_OVERHEAD
- * recommended)
- * @param workmem Workspace buffer (must be at least LZ77_WORKMEM_SIZE bytes)
- *                This buffer is used for the hash table and can be reused
- *                between compression calls.
- *
- * @return Size of compressed data in bytes, or 0 if input length <= 0
- *
- * @note The output buffer should be at least as large as the input to handle
- *       worst-case scenarios where data expands rather than compresses.
- *
- * @note This function does not allocate any memory internally. All buffers
- *       must be provided by the caller.
- *
- * Usage Example:
- * @code
- *   uint8_t input[1024] = {...};
- *   uint8_t output[1024 + COMPRESS_OVERHEAD];
- *   uint8_t workspace[LZ77_WORKMEM_SIZE];
+ * What the compressor did, filled in by lz77_compress_stats(). All fields are
+ * totals that each call adds to, so one struct can cover many blocks.
+ */
+struct lz77_stats {
+    uint64_t blocks;       /* calls */
+    uint64_t input_bytes;  /* bytes compressed */
+    uint64_t output_bytes; /* bytes produced */
+
+    uint64_t literal_runs;  /* runs of literals, before MAX_COPY splitting */
+    uint64_t literal_bytes; /* bytes sent as literals */
+    uint64_t matches;       /* matches, before MAX_LEN splitting */
+    uint64_t match_bytes;   /* bytes covered by matches */
+
+    /* matches by length in bytes and by distance */
+    uint64_t match_length[LZ77_STATS_BUCKETS];
+    uint64_t match_distance[LZ77_STATS_BUCKETS];
+
+    /* Hash table probes: the slot held a position out of the window, or one
+     * whose first 3 bytes differ (a collision), or a true match. Lazy
+     * matching probes too, so probes exceed the positions scanned.
+     */
+    uint64_t probes;
+    uint64_t probe_out_of_window;
+    uint64_t probe_collisions;
+    uint64_t probe_matches;
+
+    /* Table fill level: slots written by each block and slots available,
+     * summed over blocks of at least MIN_INPUT_SIZE bytes
+     */
+    uint64_t table_used;
+    uint64_t table_slots;
+
+    uint64_t lazy_step1; /* match at ip+1 replaced the one at ip */
+    uint64_t lazy_step2; /* match at ip+2 replaced the best so far */
+    uint64_t backfills;  /* hash entries seeded inside long matches */
+
+    /* extra control bytes spent on runs longer than MAX_COPY and on matches
+     * longer than one token can hold
+     */
+    uint64_t literal_split_bytes;
+    uint64_t match_split_bytes;
+};
+
+static inline uint32_t lz77_stats_bucket(uint32_t v)
+{
+    uint32_t bucket = 0;
+    while (v >>= 1)
+        bucket++;
+    return bucket < LZ77_STATS_BUCKETS ? bucket : LZ77_STATS_BUCKETS - 1;
+}
+
+static inline void lz77_stats_literals(struct lz77_stats *stats, uint32_t runs)
+{
+    if (!runs)
+        return;
+    stats->literal_runs++;
+    stats->literal_bytes += runs;
+    stats->literal_split_bytes += (runs - 1) / MAX_COPY;
+}
+
+/* Classifies one probe: candidate is LZ77_CANDIDATE() for the slot */
+static inline void lz77_stats_probe(struct lz77_stats *stats,
+                                    int candidate,
+                                    const uint8_t *ref,
+                                    uint32_t seq)
+{
+    stats->probes++;
+    if (!candidate)
+        stats->probe_out_of_window++;
+    else if ((lz77_read32(ref) & 0xffffff) != seq)
+        stats->probe_collisions++;
+    else
+        stats->probe_matches++;
+}
+
+/* len and distance as passed to match(): a match of len + 2 bytes */
+static inline void lz77_stats_match(struct lz77_stats *stats,
+                                    uint32_t len,
+                                    uint32_t distance)
+{
+    stats->matches++;
+    stats->match_bytes += len + 2;
+    stats->match_length[lz77_stats_bucket(len + 2)]++;
+    stats->match_distance[lz77_stats_bucket(distance)]++;
+    stats->match_split_bytes += 3 * ((len - 1) / (MAX_LEN - 2));
+}
+
+/* Statistics are collected only for a non-NULL stats pointer, which is a
+ * constant in every public entry point, so the checks fold away
+ */
+#define LZ77_STAT(stats, expr) \
+    do {                       \
+        if (stats) {           \
+            expr;              \
+        }                      \
+    } while (0)
+#else
+struct lz77_stats;
+#define LZ77_STAT(stats, expr) ((void) (stats))
+#endif
+
+/* A hash table candidate is usable when it lies inside the window and within
+ * the current input or the history before it
+ */
+#define LZ77_CANDIDATE(distance, ip, in, history) \
+    ((distance) < MAX_DISTANCE &&                 \
+     (distance) <= (uint32_t) ((ip) - (in)) + (history))
+
+/**
+ * Compression core shared by lz77_compress() and lz77_compress_continue().
  *
- *   int compressed_size = lz77_compress(input, 1024, output, workspace);
- *   if (compressed_size > 0) {
- *       // compressed_size bytes in output buffer contain compressed data
- *   }
- * @endcode
+ * The hash table holds stream positions: @p pos is the position of in[0], and
+ * the @p history bytes before @p in are earlier stream data that matches may
+ * reference. A standalone block is position 0 with no history. @p stats is
+ * NULL unless called from lz77_compress_stats().
  */
-int lz77_compress(const void *in, int length, void *out, void *workmem)
+static LZ77_INLINE int lz77_compress_block(const uint8_t *in,
+                                           int length,
+                                           uint8_t *out,
+                                           uint32_t *htab,
+                                           uint32_t pos,
+                                           uint32_t history,
+                                           struct lz77_stats *stats)
 {
-    const uint8_t *ip = (const uint8_t *) in, *ip_start = ip;
+    const uint8_t *ip = in;
     const uint8_t *in_end = ip + length;
-    uint8_t *op = (uint8_t *) out;
+    uint8_t *op = out;
 
     /* Handle small inputs that don't meet MIN_INPUT_SIZE */
     if (length <= 0)
         return 0;
-    if (length < MIN_INPUT_SIZE)
-        return literals((uint32_t) length, ip, op) - (uint8_t *) out;
+    if (length < MIN_INPUT_SIZE) {
+        LZ77_STAT(stats, lz77_stats_literals(stats, (uint32_t) length));
+        return literals((uint32_t) length, ip, op) - out;
+    }
 
     const uint8_t *ip_limit = ip + length - MIN_INPUT_SIZE;
-
-    uint32_t *htab = (uint32_t *) workmem;
     uint32_t seq, hash;
-    memset(htab, 0, LZ77_WORKMEM_SIZE);
 
     /* we start with literal copy */
     const uint8_t *anchor = ip;
@@ -227,11 +358,15 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
         do {
             seq = lz77_read32(ip) & 0xffffff;
             hash = lz77_hash(seq);
-            ref = ip_start + htab[hash];
-            distance = ip - ref;
-            htab[hash] = ip - ip_start;
-            cmp = (distance < MAX_DISTANCE) ? lz77_read32(ref) & 0xffffff
-                                            : 0x1000000;
+            distance = pos + (uint32_t) (ip - in) - htab[hash];
+            ref = ip - distance;
+            htab[hash] = pos + (uint32_t) (ip - in);
+            LZ77_WORK(probe, 1);
+            cmp = LZ77_CANDIDATE(distance, ip, in, history)
+                      ? lz77_read32(ref) & 0xffffff
+                      : 0x1000000;
+            LZ77_STAT(stats,
+                      lz77_stats_probe(stats, cmp != 0x1000000, ref, seq));
 
             if (LZ77_UNLIKELY(ip >= ip_limit))
                 break;
@@ -244,8 +379,10 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
 
         --ip;
 
-        if (ip > anchor)
+        if (ip > anchor) {
+            LZ77_STAT(stats, lz77_stats_literals(stats, ip - anchor));
             op = literals(ip - anchor, anchor, op);
+        }
 
         uint32_t len =
             match_len(ref + MIN_MATCH_LEN, ip + MIN_MATCH_LEN, in_end) + 1;
@@ -267,12 +404,19 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
         uint32_t lazy_step = 0; /* 0=use ip, 1=use ip+1, 2=use ip+2 */
 
         if (LZ77_LIKELY(ip + 1 < ip_limit)) {
+            LZ77_WORK(probe, 1);
             uint32_t seq_next = lz77_read32(ip + 1) & 0xffffff;
             uint32_t hash_next = lz77_hash(seq_next);
-            const uint8_t *ref_next = ip_start + htab[hash_next];
-            uint32_t distance_next = (ip + 1) - ref_next;
-
-            if (distance_next < MAX_DISTANCE &&
+            uint32_t distance_next =
+                pos + (uint32_t) (ip + 1 - in) - htab[hash_next];
+            const uint8_t *ref_next = (ip + 1) - distance_next;
+            LZ77_STAT(stats,
+                      lz77_stats_probe(stats,
+                                       LZ77_CANDIDATE(distance_next, ip + 1,
+                                                      in, history),
+                                       ref_next, seq_next));
+
+            if (LZ77_CANDIDATE(distance_next, ip + 1, in, history) &&
                 (lz77_read32(ref_next) & 0xffffff) == seq_next) {
                 uint32_t len_next = match_len(ref_next + MIN_MATCH_LEN,
                                               ip + 1 + MIN_MATCH_LEN, in_end) +
@@ -280,6 +424,7 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
 
                 /* accept lazy if worth the extra literal cost */
                 if (len_next > len + (len < 7 ? 1 : 0)) {
+                    LZ77_STAT(stats, stats->lazy_step1++);
                     lazy_step = 1;
                     len = len_next;
                     distance = distance_next;
@@ -290,12 +435,19 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
 
         /* Step 2: Check if ip+2 has even better match (two-step lazy) */
         if (LZ77_LIKELY(ip + 2 < ip_limit)) {
+            LZ77_WORK(probe, 1);
             uint32_t seq_next2 = lz77_read32(ip + 2) & 0xffffff;
             uint32_t hash_next2 = lz77_hash(seq_next2);
-            const uint8_t *ref_next2 = ip_start + htab[hash_next2];
-            uint32_t distance_next2 = (ip + 2) - ref_next2;
-
-            if (distance_next2 < MAX_DISTANCE &&
+            uint32_t distance_next2 =
+                pos + (uint32_t) (ip + 2 - in) - htab[hash_next2];
+            const uint8_t *ref_next2 = (ip + 2) - distance_next2;
+            LZ77_STAT(stats,
+                      lz77_stats_probe(stats,
+                                       LZ77_CANDIDATE(distance_next2, ip + 2,
+                                                      in, history),
+                                       ref_next2, seq_next2));
+
+            if (LZ77_CANDIDATE(distance_next2, ip + 2, in, history) &&
                 (lz77_read32(ref_next2) & 0xffffff) == seq_next2) {
                 uint32_t len_next2 = match_len(ref_next2 + MIN_MATCH_LEN,
                                                ip + 2 + MIN_MATCH_LEN, in_end) +
@@ -303,6 +455,7 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
 
                 /* accept if better than best considering 2-literal cost */
                 if (len_next2 > len + (len < 7 ? 1 : 0)) {
+                    LZ77_STAT(stats, stats->lazy_step2++);
                     lazy_step = 2;
                     len = len_next2;
                     distance = distance_next2;
@@ -313,11 +466,13 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
 
         /* Emit literals and update position based on lazy decision */
         if (lazy_step > 0) {
+            LZ77_STAT(stats, lz77_stats_literals(stats, lazy_step));
             op = literals(lazy_step, ip, op);
             ip += lazy_step;
             anchor = ip;
         }
 
+        LZ77_STAT(stats, lz77_stats_match(stats, len, distance));
         op = match(len, distance, op);
 
         /* update the hash at match boundary */
@@ -325,10 +480,10 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
         if (LZ77_LIKELY(ip + 4 <= in_end)) {
             seq = lz77_read32(ip);
             hash = lz77_hash(seq & 0xffffff);
-            htab[hash] = ip++ - ip_start;
+            htab[hash] = pos + (uint32_t) (ip++ - in);
             seq >>= 8;
             hash = lz77_hash(seq);
-            htab[hash] = ip++ - ip_start;
+            htab[hash] = pos + (uint32_t) (ip++ - in);
         } else {
             /* Not enough space for hash updates, but still advance ip by 2 */
             if (ip < in_end)
@@ -340,66 +495,229 @@ int lz77_compress(const void *in, int length, void *out, void *workmem)
         /* light backfill: seed dictionary for long matches */
         if (len > 12) {
             const uint8_t *p = ip - len + 5;
-            if (p > ip_start && p + 3 < ip && p + 4 <= in_end) {
+            if (p > in && p + 3 < ip && p + 4 <= in_end) {
                 uint32_t s = lz77_read32(p) & 0xffffff;
                 uint32_t h = lz77_hash(s);
-                htab[h] = p - ip_start;
+                htab[h] = pos + (uint32_t) (p - in);
+                LZ77_STAT(stats, stats->backfills++);
             }
         }
 
         anchor = ip;
     }
 
-    return literals((uint8_t *) in + length - anchor, anchor, op) -
-           (uint8_t *) out;
+    LZ77_STAT(stats, lz77_stats_literals(stats, in_end - anchor));
+    return literals(in_end - anchor, anchor, op) - out;
 }
 
 /**
- * Decompresses a block of LZ77-compressed data.
+ * Compresses a block of data using the LZ77 algorithm with lazy matching.
  *
- * This function decompresses data that was compressed with lz77_compress().
- * Decompression is fast and does not require a workspace buffer.
+ * This function implements LZ77 compression with the following optimizations:
+ * - Hash-based dictionary lookup (8192-entry table)
+ * - Lazy matching for improved compression ratios
+ * - Cache-friendly memory access patterns
  *
- * @param in      Pointer to compressed data buffer
- * @param length  Length of compressed data in bytes
- * @param out     Pointer to output buffer for decompressed data
- * @param max_out Maximum size of output buffer (prevents buffer overflow)
+ * @param in      Pointer to the input data buffer
+ * @param length  Length of input data in bytes (can be 0)
+ * @param out     Pointer to output buffer for compressed data
+ *                (must be large enough: input_size + COMPRESS_OVERHEAD
+ * recommended)
+ * @param workmem Workspace buffer (must be at least LZ77_WORKMEM_SIZE bytes)
+ *                This buffer is used for the hash table and can be reused
+ *                between compression calls.
  *
- * @return Size of decompressed data in bytes, or 0 on error
+ * @return Size of compressed data in bytes, or 0 if input length <= 0
  *
- * @note Returns 0 if:
- *       - Input length is <= 0
- *       - Output buffer is too small (max_out insufficient)
- *       - Compressed data is corrupted or invalid
- *       - Backward reference goes outside valid range
+ * @note The output buffer should be at least as large as the input to handle
+ *       worst-case scenarios where data expands rather than compresses.
  *
- * @note This function does not allocate any memory internally.
+ * @note This function does not allocate any memory internally. All buffers
+ *       must be provided by the caller.
  *
  * Usage Example:
  * @code
- *   uint8_t compressed[512] = {...};  // Previously compressed data
- *   uint8_t output[1024];  // Buffer large enough for decompressed data
+ *   uint8_t input[1024] = {...};
+ *   uint8_t output[1024 + COMPRESS_OVERHEAD];
+ *   uint8_t workspace[LZ77_WORKMEM_SIZE];
  *
- *   int decompressed_size = lz77_decompress(compressed, 512, output, 1024);
- *   if (decompressed_size > 0) {
- *       // output buffer contains decompressed_size bytes of original data
- *   } else {
- *       // Decompression failed - corrupt data or insufficient buffer
+ *   int compressed_size = lz77_compress(input, 1024, output, workspace);
+ *   if (compressed_size > 0) {
+ *       // compressed_size bytes in output buffer contain compressed data
  *   }
  * @endcode
  */
-int lz77_decompress(const void *in, int length, void *out, int max_out)
+int lz77_compress(const void *in, int length, void *out, void *workmem)
+{
+    LZ77_PROBE2(compress__start, in, length);
+    if (length >= MIN_INPUT_SIZE)
+        memset(workmem, 0, LZ77_WORKMEM_SIZE);
+    int size = lz77_compress_block((const uint8_t *) in, length,
+                                   (uint8_t *) out, (uint32_t *) workmem, 0, 0,
+                                   NULL);
+    LZ77_PROBE2(compress__end, length, size);
+    return size;
+}
+
+#ifdef LZ77_ENABLE_STATS
+/**
+ * lz77_compress() that also adds what the compressor did to @p stats: token
+ * counts, match length and distance histograms, hash probe outcomes and
+ * table fill level, lazy matching and backfill decisions, and the bytes spent
+ * on splitting long runs and matches. The output is identical to
+ * lz77_compress().
+ *
+ * Only available when LZ77_ENABLE_STATS is defined before including this
+ * header; otherwise no statistics code is compiled at all.
+ */
+int lz77_compress_stats(const void *in,
+                        int length,
+                        void *out,
+                        void *workmem,
+                        struct lz77_stats *stats)
+{
+    if (length >= MIN_INPUT_SIZE)
+        memset(workmem, 0, LZ77_WORKMEM_SIZE);
+    int size = lz77_compress_block((const uint8_t *) in, length,
+                                   (uint8_t *) out, (uint32_t *) workmem, 0, 0,
+                                   stats);
+    if (length > 0) {
+        stats->blocks++;
+        stats->input_bytes += (uint64_t) length;
+        stats->output_bytes += (uint64_t) size;
+    }
+
+    /* the table was cleared and every position stored is at least 2 */
+    if (length >= MIN_INPUT_SIZE) {
+        const uint32_t *htab = (const uint32_t *) workmem;
+        for (int i = 0; i < HASH_SIZE; i++)
+            stats->table_used += htab[i] != 0;
+        stats->table_slots += HASH_SIZE;
+    }
+    return size;
+}
+#endif
+
+/**
+ * Streaming compression context.
+ *
+ * Consecutive lz77_compress_continue() calls share one hash table, so each
+ * block may reference up to MAX_DISTANCE bytes of the data compressed before
+ * it. Every call still produces a complete block: the token stream ends with
+ * the input, which makes each call a flush point that costs nothing in ratio
+ * for later blocks.
+ *
+ * Positions are 32-bit. Before the next block would overflow them, the table
+ * is rebased (see lz77_stream_rebase()), so a context compresses a stream of
+ * any length in constant memory.
+ */
+struct lz77_stream {
+    uint32_t htab[HASH_SIZE];
+    uint32_t position; /* stream position of the next input byte */
+    uint32_t history;  /* bytes of earlier input matches may reference */
+};
+
+/**
+ * Start a new stream. A context can be reset this way at any time, after
+ * which the next block no longer depends on earlier ones.
+ */
+void lz77_stream_init(struct lz77_stream *stream)
+{
+    memset(stream->htab, 0, sizeof(stream->htab));
+    stream->position = 0;
+    stream->history = 0;
+}
+
+/* Largest piece compressed in one pass; longer inputs are split into pieces
+ * whose token streams are simply concatenated, which is still one valid block
+ */
+#define LZ77_STREAM_SPAN (1u << 30)
+
+/**
+ * Move the table base forward by a multiple of MAX_DISTANCE so the position
+ * drops below 2 * MAX_DISTANCE. Entries keep their distance to the position;
+ * those older than the shift were out of the window already and become 0,
+ * which the window check rejects. Matches found afterwards are exactly the
+ * ones found without rebasing.
+ */
+static void lz77_stream_rebase(struct lz77_stream *stream)
+{
+    uint32_t shift =
+        (stream->position - MAX_DISTANCE) & ~(uint32_t) (MAX_DISTANCE - 1);
+
+    for (uint32_t i = 0; i < HASH_SIZE; i++)
+        stream->htab[i] =
+            stream->htab[i] >= shift ? stream->htab[i] - shift : 0;
+    stream->position -= shift;
+}
+
+/**
+ * Compresses the next block of a stream.
+ *
+ * Blocks are compressed like lz77_compress() but may refer back into earlier
+ * blocks, so the caller keeps the previous input available: the last
+ * min(stream->history, MAX_DISTANCE) bytes of the stream must sit in memory
+ * immediately before @p in. Compressing the stream in place in one buffer, or
+ * in a buffer that slides its last MAX_DISTANCE bytes to the front before it
+ * fills up, meets this.
+ *
+ * @param stream  Context prepared by lz77_stream_init()
+ * @param in      Next part of the stream
+ * @param length  Length of the input in bytes (can be 0, no upper limit)
+ * @param out     Output buffer, sized as for lz77_compress()
+ *
+ * @return Size of the compressed block in bytes
+ *
+ * @note Decode the blocks in order with lz77_decompress_continue(), writing
+ *       each one right after the output of the previous one.
+ */
+size_t lz77_compress_continue(struct lz77_stream *stream,
+                              const void *in,
+                              size_t length,
+                              void *out)
+{
+    const uint8_t *ip = (const uint8_t *) in;
+    uint8_t *op = (uint8_t *) out;
+
+    LZ77_PROBE2(compress__start, in, length);
+    while (length > 0) {
+        uint32_t n = length < LZ77_STREAM_SPAN ? (uint32_t) length
+                                               : LZ77_STREAM_SPAN;
+        if (LZ77_UNLIKELY(stream->position > UINT32_MAX - n))
+            lz77_stream_rebase(stream);
+
+        op += lz77_compress_block(ip, (int) n, op, stream->htab,
+                                  stream->position, stream->history, NULL);
+
+        stream->position += n;
+        stream->history = n >= MAX_DISTANCE - stream->history
+                              ? MAX_DISTANCE
+                              : stream->history + n;
+        ip += n, length -= n;
+    }
+    LZ77_PROBE2(compress__end, ip - (const uint8_t *) in,
+                op - (uint8_t *) out);
+    return op - (uint8_t *) out;
+}
+
+/* Decompression core; backward references may reach down to @p low */
+static LZ77_INLINE size_t lz77_decompress_block(const uint8_t *in,
+                                                size_t length,
+                                                uint8_t *out,
+                                                size_t max_out,
+                                                const uint8_t *low)
 {
     /* Validate input length before any pointer operations */
-    if (length <= 0)
+    if (length == 0)
         return 0;
 
-    const uint8_t *ip = (const uint8_t *) in, *ip_limit = ip + length;
+    const uint8_t *ip = in, *ip_limit = ip + length;
     const uint8_t *ip_bound = (length >= 2) ? (ip_limit - 2) : ip;
-    uint8_t *op = (uint8_t *) out, *op_limit = op + max_out;
+    uint8_t *op = out, *op_limit = op + max_out;
     uint32_t ctrl = (*ip++) & 31;
 
     while (1) {
+        LZ77_WORK(token, 1);
         if (ctrl >= 32) {
             uint32_t len = (ctrl >> 5) - 1, ofs = (ctrl & 31) << 8;
             const uint8_t *ref = op - ofs - 1;
@@ -411,11 +729,12 @@ int lz77_decompress(const void *in, int length, void *out, int max_out)
 
             ref -= *ip++;
             len += 3;
-            if (LZ77_UNLIKELY(op + len > op_limit ||
-                              ref < (const uint8_t *) out))
+            if (LZ77_UNLIKELY(op + len > op_limit || ref < low))
                 return 0;
             for (uint32_t remain = len, distance = op - ref; remain;) {
                 uint32_t chunk = remain < distance ? remain : distance;
+                LZ77_WORK(copy, 1);
+                LZ77_WORK(output, chunk);
                 memcpy(op, ref, chunk);
                 op += chunk, ref += chunk, remain -= chunk;
             }
@@ -423,6 +742,8 @@ int lz77_decompress(const void *in, int length, void *out, int max_out)
             ctrl++;
             if (LZ77_UNLIKELY(op + ctrl > op_limit || ip + ctrl > ip_limit))
                 return 0;
+            LZ77_WORK(copy, 1);
+            LZ77_WORK(output, ctrl);
             memcpy(op, ip, ctrl);
             ip += ctrl, op += ctrl;
         }
@@ -433,7 +754,79 @@ int lz77_decompress(const void *in, int length, void *out, int max_out)
         ctrl = *ip++;
     }
 
-    return op - (uint8_t *) out;
+    return op - out;
+}
+
+/**
+ * Decompresses a block of LZ77-compressed data.
+ *
+ * This function decompresses data that was compressed with lz77_compress().
+ * Decompression is fast and does not require a workspace buffer.
+ *
+ * @param in      Pointer to compressed data buffer
+ * @param length  Length of compressed data in bytes
+ * @param out     Pointer to output buffer for decompressed data
+ * @param max_out Maximum size of output buffer (prevents buffer overflow)
+ *
+ * @return Size of decompressed data in bytes, or 0 on error
+ *
+ * @note Returns 0 if:
+ *       - Input length is <= 0
+ *       - Output buffer is too small (max_out insufficient)
+ *       - Compressed data is corrupted or invalid
+ *       - Backward reference goes outside valid range
+ *
+ * @note This function does not allocate any memory internally.
+ *
+ * Usage Example:
+ * @code
+ *   uint8_t compressed[512] = {...};  // Previously compressed data
+ *   uint8_t output[1024];  // Buffer large enough for decompressed data
+ *
+ *   int decompressed_size = lz77_decompress(compressed, 512, output, 1024);
+ *   if (decompressed_size > 0) {
+ *       // output buffer contains decompressed_size bytes of original data
+ *   } else {
+ *       // Decompression failed - corrupt data or insufficient buffer
+ *   }
+ * @endcode
+ */
+int lz77_decompress(const void *in, int length, void *out, int max_out)
+{
+    if (length <= 0 || max_out < 0)
+        return 0;
+    LZ77_PROBE2(decompress__start, in, length);
+    int size = (int) lz77_decompress_block((const uint8_t *) in,
+                                           (size_t) length, (uint8_t *) out,
+                                           (size_t) max_out,
+                                           (const uint8_t *) out);
+    LZ77_PROBE2(decompress__end, length, size);
+    return size;
+}
+
+/**
+ * Decompresses the next block of a stream compressed with
+ * lz77_compress_continue().
+ *
+ * The block may copy from the @p history bytes immediately before @p out,
+ * which must hold the end of the stream decoded so far. Passing the number of
+ * bytes decoded so far, capped at MAX_DISTANCE, accepts every valid block;
+ * references reaching further back are rejected as corrupt.
+ *
+ * @return Size of decompressed data in bytes, or 0 on error
+ */
+size_t lz77_decompress_continue(const void *in,
+                                size_t length,
+                                void *out,
+                                size_t max_out,
+                                size_t history)
+{
+    LZ77_PROBE2(decompress__start, in, length);
+    size_t size = lz77_decompress_block((const uint8_t *) in, length,
+                                        (uint8_t *) out, max_out,
+                                        (const uint8_t *) out - history);
+    LZ77_PROBE2(decompress__end, length, size);
+    return size;
 }
 
 #endif /* LZ77_H */
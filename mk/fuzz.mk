@@ -121,3 +121,74 @@ fuzz-verbose: tools
 		-print_final_stats=1 \
 		-dict=$(FUZZ_DIR)/fuzz.dict \
 		$(FUZZ_CORPUS)/
+
+# Worst-case work fuzzing (tests/fuzz-perf.c)
+#
+# Usage: make fuzz-perf        (fuzz for FUZZ_TIME seconds)
+#        make fuzz-perf-check  (replay the seeds and the regression corpus)
+#
+# An input doing more work per byte than the bound aborts the run and is saved
+# to FUZZ_PERF_REGRESS; commit it with the fix so the check keeps replaying it.
+
+FUZZ_PERF_TARGET = $(FUZZ_DIR)/fuzz-perf
+FUZZ_PERF_CORPUS = $(FUZZ_DIR)/corpus-perf
+FUZZ_PERF_REGRESS = $(FUZZ_DIR)/perf-corpus
+
+# Shell commands setting LLVM_CC and LIBCXX_FLAGS, or failing without clang
+define find-llvm-cc
+LLVM_CC=""; \
+for cc in /opt/homebrew/opt/llvm/bin/clang /usr/local/opt/llvm/bin/clang clang; do \
+	if [ -x "$$cc" ] 2>/dev/null || command -v "$$cc" >/dev/null 2>&1; then \
+		ver=$$($$cc --version 2>/dev/null | head -1); \
+		case "$$ver" in \
+			*Apple*) continue ;; \
+			*) LLVM_CC="$$cc"; break ;; \
+		esac; \
+	fi; \
+done; \
+if [ -z "$$LLVM_CC" ]; then \
+	printf "$(RED)Error: LLVM clang not found$(NC)\n"; \
+	echo "libFuzzer requires LLVM clang, see 'make fuzz'."; \
+	exit 1; \
+fi; \
+LLVM_DIR=$$(dirname $$(dirname $$LLVM_CC)); \
+if [ -d "$$LLVM_DIR/lib/c++" ]; then \
+	LIBCXX_FLAGS="-stdlib=libc++ -L$$LLVM_DIR/lib/c++ -Wl,-rpath,$$LLVM_DIR/lib/c++"; \
+else \
+	LIBCXX_FLAGS=""; \
+fi
+endef
+
+.PHONY: fuzz-perf fuzz-perf-check fuzz-perf-build
+
+# Optimized like a release build, without sanitizers: tests/fuzz.c covers
+# memory safety, this target only counts work
+fuzz-perf-build:
+	@$(find-llvm-cc); \
+	$$LLVM_CC -g -O2 -I. -fsanitize=fuzzer $$LIBCXX_FLAGS \
+		$(FUZZ_DIR)/fuzz-perf.c -o $(FUZZ_PERF_TARGET)
+	@# Seeds near the known worst cases: long runs and short periods for the
+	@# lazy matcher, distance-1 matches for the decoder's overlapping copies
+	@mkdir -p $(FUZZ_PERF_CORPUS) $(FUZZ_PERF_REGRESS)
+	@head -c 65536 /dev/zero > $(FUZZ_PERF_CORPUS)/zeros.bin
+	@head -c 1024 /dev/urandom > $(FUZZ_PERF_CORPUS)/random.bin 2>/dev/null || true
+	@for i in $$(seq 2048); do printf 'ab'; done > $(FUZZ_PERF_CORPUS)/period2.bin
+	@for i in $$(seq 1024); do printf 'abcabd'; done > $(FUZZ_PERF_CORPUS)/period6.bin
+	@{ printf '\000A'; for i in $$(seq 2048); do printf '\340\377\000'; done; } \
+		> $(FUZZ_PERF_CORPUS)/overlap_max.bin
+	@{ printf '\001AB'; for i in $$(seq 2048); do printf '\100\001'; done; } \
+		> $(FUZZ_PERF_CORPUS)/overlap_d2.bin
+	@for i in $$(seq 2048); do printf '\000A'; done > $(FUZZ_PERF_CORPUS)/literal1.bin
+
+fuzz-perf: fuzz-perf-build
+	./$(FUZZ_PERF_TARGET) -max_len=65536 -timeout=10 \
+		-max_total_time=$(FUZZ_TIME) \
+		-print_final_stats=1 \
+		-dict=$(FUZZ_DIR)/fuzz.dict \
+		-artifact_prefix=$(FUZZ_PERF_REGRESS)/ \
+		$(FUZZ_PERF_CORPUS)/ $(FUZZ_PERF_REGRESS)/
+
+# Runs every saved input once; fails if any is over its bound
+fuzz-perf-check: fuzz-perf-build
+	@find $(FUZZ_PERF_CORPUS) $(FUZZ_PERF_REGRESS) -type f | \
+		xargs ./$(FUZZ_PERF_TARGET)
@@ -0,0 +1,270 @@
+#!/bin/bash
+# Performance regression gate: run lz77bench on a fixed corpus subset several
+# times and compare compress/decompress speed with a checked-in baseline
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+DATASET_DIR="${PROJECT_ROOT}/tests/dataset"
+BENCH="${PROJECT_ROOT}/tools/lz77bench"
+BASELINE="${PROJECT_ROOT}/tests/bench-baseline.json"
+
+# Fixed subset of the corpus: text, markup, spreadsheet, image, binary and
+# source, about 40 MB in total
+BENCH_FILES=(
+    canterbury/alice29.txt
+    canterbury/kennedy.xls
+    canterbury/ptt5
+    silesia/dickens
+    silesia/samba
+    silesia/x-ray
+    silesia/xml
+)
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+log_info()
+{
+    echo -e "${GREEN}[INFO]${NC} $1"
+}
+
+log_warn()
+{
+    echo -e "${YELLOW}[WARN]${NC} $1"
+}
+
+log_error()
+{
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+usage()
+{
+    cat << EOF
+Usage: $0 [options] [file...]
+
+Runs tools/lz77bench --json several times on a fixed subset of the test
+corpus (or on the files given) and compares the median compress and
+decompress speed of every file and of the total with a baseline. A speed
+counts as a regression when it is slower than the baseline by more than the
+largest of the tolerance and the noise of either measurement, three times
+the median absolute deviation in percent. A missing baseline is an error;
+only -u records one.
+
+Options:
+  -b FILE   baseline (default: tests/bench-baseline.json)
+  -o FILE   also write the measured medians as JSON to FILE
+  -r N      benchmark runs (default: 5)
+  -i N      timed iterations per run (default: 10)
+  -t PCT    tolerated slowdown in percent (default: 5)
+  -u        record the results as the new baseline instead of comparing
+  -h        show this help
+EOF
+}
+
+RUNS=5
+ITERATIONS=10
+TOLERANCE=5
+UPDATE=0
+OUTPUT=""
+
+while getopts "b:o:r:i:t:uh" opt; do
+    case $opt in
+        b) BASELINE="$OPTARG" ;;
+        o) OUTPUT="$OPTARG" ;;
+        r) RUNS="$OPTARG" ;;
+        i) ITERATIONS="$OPTARG" ;;
+        t) TOLERANCE="$OPTARG" ;;
+        u) UPDATE=1 ;;
+        h)
+            usage
+            exit 0
+            ;;
+        *)
+            usage
+            exit 1
+            ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+for value in "$RUNS" "$ITERATIONS"; do
+    if ! [[ "$value" =~ ^[1-9][0-9]*$ ]]; then
+        log_error "Invalid count: $value"
+        exit 1
+    fi
+done
+if ! [[ "$TOLERANCE" =~ ^[0-9]+(\.[0-9]+)?$ ]]; then
+    log_error "Invalid tolerance: $TOLERANCE"
+    exit 1
+fi
+
+if [ ! -x "$BENCH" ]; then
+    log_error "lz77bench not found. Run 'make' first."
+    exit 1
+fi
+
+if [ "$UPDATE" -eq 0 ] && [ ! -f "$BASELINE" ]; then
+    log_error "No baseline at $BASELINE. Run 'make bench-baseline' to record one."
+    exit 1
+fi
+
+if [ $# -gt 0 ]; then
+    FILES=("$@")
+else
+    FILES=()
+    for f in "${BENCH_FILES[@]}"; do
+        if [ ! -f "${DATASET_DIR}/$f" ]; then
+            log_error "Missing ${DATASET_DIR}/$f. Run 'make dataset' first."
+            exit 1
+        fi
+        FILES+=("$f")
+    done
+    cd "$DATASET_DIR"
+fi
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+HOST="$(uname -m) $(awk -F': ' '/^model name/ {print $2; exit}' /proc/cpuinfo 2> /dev/null)"
+
+log_info "Running lz77bench ${RUNS} time(s), ${ITERATIONS} iterations each"
+for r in $(seq "$RUNS"); do
+    if ! "$BENCH" --json -i "$ITERATIONS" "${FILES[@]}" > "$TEMP_DIR/run$r.json"; then
+        log_error "lz77bench failed"
+        exit 1
+    fi
+done
+
+# Lines holding a file or the total, from lz77bench or a baseline, as
+# tab-separated name, comp_mb_s, comp_mad_pct, decomp_mb_s, decomp_mad_pct
+extract()
+{
+    awk '
+        function field(key,    m) {
+            if (!match($0, "\"" key "\": [0-9.]+"))
+                return 0
+            m = substr($0, RSTART, RLENGTH)
+            sub(/.*: /, "", m)
+            return m
+        }
+        /"name": "/ {
+            name = $0
+            sub(/.*"name": "/, "", name)
+            sub(/", .*/, "", name)
+            printf "%s\t%s\t%s\t%s\t%s\n", name, field("comp_mb_s"),
+                field("comp_mad_pct"), field("decomp_mb_s"),
+                field("decomp_mad_pct")
+        }' "$@"
+}
+
+# Median speed over the runs per name, and the noise in percent: three times
+# the larger of the run-to-run and the within-run median absolute deviation
+extract "$TEMP_DIR"/run*.json | awk -F'\t' '
+    function median(a, n,    i, j, t) {
+        for (i = 2; i <= n; i++)
+            for (j = i; j > 1 && a[j - 1] > a[j]; j--) {
+                t = a[j]; a[j] = a[j - 1]; a[j - 1] = t
+            }
+        return n % 2 ? a[(n + 1) / 2] : (a[n / 2] + a[n / 2 + 1]) / 2
+    }
+    function summarize(list, mads,    n, v, m, i, d, dev, run, within) {
+        n = split(list, v, " ")
+        m = median(v, n)
+        for (i = 1; i <= n; i++) {
+            d = v[i] - m
+            dev[i] = d < 0 ? -d : d
+        }
+        run = m > 0 ? 100 * median(dev, n) / m : 0
+        n = split(mads, v, " ")
+        within = median(v, n)
+        return sprintf("%.2f\t%.2f", m, 3 * (run > within ? run : within))
+    }
+    !($1 in seen) { seen[$1] = 1; order[++count] = $1 }
+    { comp[$1] = comp[$1] " " $2; cmad[$1] = cmad[$1] " " $3
+      decomp[$1] = decomp[$1] " " $4; dmad[$1] = dmad[$1] " " $5 }
+    END {
+        for (i = 1; i <= count; i++) {
+            k = order[i]
+            printf "%s\t%s\t%s\n", k, summarize(comp[k], cmad[k]),
+                summarize(decomp[k], dmad[k])
+        }
+    }' > "$TEMP_DIR/current.tsv"
+
+# Write medians as JSON in the layout extract() reads, noise as the MAD fields
+write_json()
+{
+    awk -F'\t' -v host="$HOST" -v iterations="$ITERATIONS" -v runs="$RUNS" '
+        BEGIN {
+            printf "{\n  \"host\": \"%s\", \"iterations\": %d, \"runs\": %d,\n", host, iterations, runs
+            printf "  \"files\": [\n"
+        }
+        { line[NR] = sprintf("{\"name\": \"%s\", \"comp_mb_s\": %s, \"comp_mad_pct\": %.2f, \"decomp_mb_s\": %s, \"decomp_mad_pct\": %.2f}", $1, $2, $3 / 3, $4, $5 / 3) }
+        END {
+            for (i = 1; i < NR; i++)
+                printf "    %s%s\n", line[i], i < NR - 1 ? "," : ""
+            printf "  ],\n  \"total\": %s\n}\n", line[NR]
+        }' "$TEMP_DIR/current.tsv"
+}
+
+if [ -n "$OUTPUT" ]; then
+    write_json > "$OUTPUT"
+    log_info "Results written to $OUTPUT"
+fi
+
+if [ "$UPDATE" -eq 1 ]; then
+    write_json > "$BASELINE"
+    log_info "Baseline written to $BASELINE; commit it to arm the gate"
+    exit 0
+fi
+
+BASE_HOST=$(sed -n 's/.*"host": "\([^"]*\)".*/\1/p' "$BASELINE" | head -n 1)
+if [ "$BASE_HOST" != "$HOST" ]; then
+    log_warn "Baseline was recorded on '$BASE_HOST', this is '$HOST'"
+fi
+
+extract "$BASELINE" > "$TEMP_DIR/baseline.tsv"
+
+# Compare every name present in both; exit status 1 on any regression
+printf "\n%-26s %-6s %10s %10s %8s %8s  %s\n" "File" "Phase" "Base MB/s" \
+    "MB/s" "Change" "Allowed" "Status"
+awk -F'\t' -v tolerance="$TOLERANCE" '
+    function check(name, phase, base, cur, noise, base_noise,
+                   change, allowed, status) {
+        allowed = noise > tolerance ? noise : tolerance
+        allowed = base_noise > allowed ? base_noise : allowed
+        change = base > 0 ? 100 * (cur - base) / base : 0
+        status = -change > allowed ? "REGRESSION" : "ok"
+        if (status != "ok")
+            failed++
+        printf "%-26s %-6s %10.1f %10.1f %+7.1f%% %7.1f%%  %s\n", name, phase,
+            base, cur, change, allowed, status
+    }
+    FNR == NR {
+        base_comp[$1] = $2; base_cnoise[$1] = 3 * $3
+        base_decomp[$1] = $4; base_dnoise[$1] = 3 * $5
+        next
+    }
+    {
+        if (!($1 in base_comp)) {
+            printf "%-26s %-6s %10s %10.1f %8s %8s  %s\n", $1, "-", "-", $2,
+                "-", "-", "not in baseline"
+            next
+        }
+        check($1, "comp", base_comp[$1], $2, $3, base_cnoise[$1])
+        check("", "decomp", base_decomp[$1], $4, $5, base_dnoise[$1])
+    }
+    END { exit failed > 0 }' "$TEMP_DIR/baseline.tsv" "$TEMP_DIR/current.tsv" &&
+    status=0 || status=1
+
+echo ""
+if [ "$status" -ne 0 ]; then
+    log_error "Throughput regressed beyond the allowed slowdown"
+    exit 1
+fi
+log_info "No throughput regression"
@@ -0,0 +1,250 @@
+#!/bin/bash
+# Measure how mzip compression and munzip extraction scale with -j
+# Datasets: Silesia (directory, mzip -r) and Enwik8 (single file)
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+DATASET_DIR="${PROJECT_ROOT}/tests/dataset"
+MZIP="${PROJECT_ROOT}/tools/mzip"
+MUNZIP="${PROJECT_ROOT}/tools/munzip"
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+log_info()
+{
+    echo -e "${GREEN}[INFO]${NC} $1"
+}
+
+log_error()
+{
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+log_section()
+{
+    echo -e "\n${BLUE}========================================${NC}"
+    echo -e "${BLUE}$1${NC}"
+    echo -e "${BLUE}========================================${NC}\n"
+}
+
+usage()
+{
+    cat << EOF
+Usage: $0 [options] [input...]
+
+Runs mzip and munzip at 1, 2, 4, ... threads up to the CPU count and reports
+the median wall time, speedup, parallel efficiency and peak memory. Inputs
+default to tests/dataset/silesia and tests/dataset/enwik/enwik8.txt;
+directories are archived with mzip -r.
+
+Options:
+  -t LIST   thread counts, e.g. "1 2 4 8" (default: powers of two up to
+            the CPU count, plus the CPU count)
+  -r N      runs per measurement, the median is reported (default: 3)
+  -p        pin each run to the first N CPUs with taskset
+  -h        show this help
+EOF
+}
+
+THREADS=""
+RUNS=3
+PIN=0
+
+while getopts "t:r:ph" opt; do
+    case $opt in
+        t) THREADS="$OPTARG" ;;
+        r) RUNS="$OPTARG" ;;
+        p) PIN=1 ;;
+        h)
+            usage
+            exit 0
+            ;;
+        *)
+            usage
+            exit 1
+            ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if ! [[ "$RUNS" =~ ^[1-9][0-9]*$ ]]; then
+    log_error "Invalid run count: $RUNS"
+    exit 1
+fi
+
+if [ ! -x "$MZIP" ]; then
+    log_error "mzip not found. Run 'make' first."
+    exit 1
+fi
+
+CPUS=$(getconf _NPROCESSORS_ONLN)
+if [ -z "$THREADS" ]; then
+    n=1
+    while [ "$n" -lt "$CPUS" ]; do
+        THREADS="$THREADS $n"
+        n=$((n * 2))
+    done
+    THREADS="$THREADS $CPUS"
+fi
+read -r -a THREAD_LIST <<< "$THREADS"
+if [ ${#THREAD_LIST[@]} -eq 0 ]; then
+    log_error "No thread counts given"
+    exit 1
+fi
+for n in "${THREAD_LIST[@]}"; do
+    if ! [[ "$n" =~ ^[1-9][0-9]*$ ]]; then
+        log_error "Invalid thread count: $n"
+        exit 1
+    fi
+done
+
+if [ "$PIN" -eq 1 ] && ! command -v taskset > /dev/null 2>&1; then
+    log_error "taskset not found, cannot pin threads"
+    exit 1
+fi
+
+INPUTS=("$@")
+if [ ${#INPUTS[@]} -eq 0 ]; then
+    for input in "${DATASET_DIR}/silesia" "${DATASET_DIR}/enwik/enwik8.txt"; do
+        [ -e "$input" ] && INPUTS+=("$input")
+    done
+    if [ ${#INPUTS[@]} -eq 0 ]; then
+        log_error "No datasets found. Run 'make dataset' first."
+        exit 1
+    fi
+fi
+
+TEMP_DIR=$(mktemp -d)
+trap "rm -rf $TEMP_DIR" EXIT
+
+# Peak resident set size in KiB of the command, from GNU time when present,
+# otherwise by sampling VmHWM (a high-water mark, so late samples suffice)
+if [ -x /usr/bin/time ] && /usr/bin/time -f %M true > /dev/null 2>&1; then
+    GNU_TIME=1
+else
+    GNU_TIME=0
+fi
+
+# run_measured <threads> <command...>: sets ELAPSED (seconds) and PEAK_KB
+run_measured()
+{
+    local threads=$1
+    shift
+    local prefix=()
+    if [ "$PIN" -eq 1 ]; then
+        prefix=(taskset -c "0-$((threads - 1))")
+    fi
+
+    local start end status=0
+    start=$(date +%s%N)
+    if [ "$GNU_TIME" -eq 1 ]; then
+        /usr/bin/time -o "$TEMP_DIR/rss" -f %M "${prefix[@]}" "$@" \
+            > /dev/null 2>&1 || status=$?
+        PEAK_KB=$(tail -n 1 "$TEMP_DIR/rss")
+    else
+        "${prefix[@]}" "$@" > /dev/null 2>&1 &
+        local pid=$! hwm
+        PEAK_KB=0
+        while kill -0 "$pid" 2> /dev/null; do
+            hwm=$(awk '/^VmHWM:/ {print $2}' "/proc/$pid/status" 2> /dev/null)
+            [ -n "$hwm" ] && [ "$hwm" -gt "$PEAK_KB" ] && PEAK_KB=$hwm
+            sleep 0.01
+        done
+        wait "$pid" || status=$?
+    fi
+    end=$(date +%s%N)
+
+    if [ "$status" -ne 0 ]; then
+        log_error "Command failed: $*"
+        exit 1
+    fi
+    ELAPSED=$(awk -v ns=$((end - start)) 'BEGIN {printf "%.3f", ns / 1e9}')
+}
+
+# median of the arguments
+median()
+{
+    printf "%s\n" "$@" | sort -g | awk '{v[NR] = $1} END {print v[int((NR + 1) / 2)]}'
+}
+
+bench_input()
+{
+    local input=$1 name bytes
+    name=$(basename "$input")
+    if [ -d "$input" ]; then
+        bytes=$(find "$input" -type f -exec stat -c %s {} + | awk '{s += $1} END {print s}')
+    else
+        bytes=$(stat -c %s "$input")
+    fi
+
+    log_section "$name ($(awk -v b="$bytes" 'BEGIN {printf "%.1f MB", b / 1e6}'))"
+    printf "%-8s %8s %8s %8s %6s %9s %9s   %8s %8s %8s %6s %9s %9s\n" \
+        "Threads" "mzip s" "MB/s" "speedup" "eff" "RSS MiB" "MiB/thr" \
+        "munzip s" "MB/s" "speedup" "eff" "RSS MiB" "MiB/thr"
+
+    local c_base="" d_base="" c_rss1="" d_rss1="" first=${THREAD_LIST[0]}
+    for n in "${THREAD_LIST[@]}"; do
+        local c_times=() d_times=() c_peak=0 d_peak=0 r
+        for r in $(seq "$RUNS"); do
+            local archive="$TEMP_DIR/archive.mz"
+            rm -f "$archive"
+            (cd "$(dirname "$input")" &&
+                run_measured "$n" "$MZIP" -r -j "$n" "$(basename "$input")" \
+                    "$archive" &&
+                echo "$ELAPSED $PEAK_KB" > "$TEMP_DIR/result")
+            read -r t kb < "$TEMP_DIR/result"
+            c_times+=("$t")
+            [ "$kb" -gt "$c_peak" ] && c_peak=$kb
+
+            rm -rf "$TEMP_DIR/out"
+            mkdir "$TEMP_DIR/out"
+            (cd "$TEMP_DIR/out" &&
+                run_measured "$n" "$MUNZIP" -j "$n" "$archive" &&
+                echo "$ELAPSED $PEAK_KB" > "$TEMP_DIR/result")
+            read -r t kb < "$TEMP_DIR/result"
+            d_times+=("$t")
+            [ "$kb" -gt "$d_peak" ] && d_peak=$kb
+        done
+
+        local c_time d_time
+        c_time=$(median "${c_times[@]}")
+        d_time=$(median "${d_times[@]}")
+        [ -z "$c_base" ] && c_base=$c_time d_base=$d_time
+        [ -z "$c_rss1" ] && c_rss1=$c_peak d_rss1=$d_peak
+
+        # speedup and efficiency against the first thread count; memory per
+        # thread is the growth over that run divided by the added threads
+        awk -v n="$n" -v first="$first" -v bytes="$bytes" \
+            -v ct="$c_time" -v cb="$c_base" -v cr="$c_peak" -v cr1="$c_rss1" \
+            -v dt="$d_time" -v db="$d_base" -v dr="$d_peak" -v dr1="$d_rss1" '
+            function per_thread(rss, rss1) {
+                if (n == first) return "-"
+                return sprintf("%.1f", (rss - rss1) / 1024 / (n - first))
+            }
+            BEGIN {
+                cs = cb / ct; ds = db / dt
+                printf "%-8d %8.3f %8.1f %8.2f %5.0f%% %9.1f %9s   %8.3f %8.1f %8.2f %5.0f%% %9.1f %9s\n",
+                    n, ct, bytes / ct / 1e6, cs, 100 * cs * first / n, cr / 1024, per_thread(cr, cr1),
+                    dt, bytes / dt / 1e6, ds, 100 * ds * first / n, dr / 1024, per_thread(dr, dr1)
+            }'
+    done
+}
+
+log_info "Threads: ${THREAD_LIST[*]} on ${CPUS} CPU(s), ${RUNS} run(s) each$([ "$PIN" -eq 1 ] && echo ", pinned")"
+if [ "$GNU_TIME" -eq 0 ]; then
+    log_info "GNU time not found, sampling peak RSS from /proc"
+fi
+
+for input in "${INPUTS[@]}"; do
+    if [ ! -e "$input" ]; then
+        log_error "Input not found: $input"
+        exit 1
+    fi
+    bench_input "$(cd "$(dirname "$input")" && pwd)/$(basename "$input")"
+done
@@ -1,12 +1,15 @@
 #!/bin/bash
-# Compare compression ratios and binary sizes of different compression tools
-# Tools: lz77 (this project), lz4, gzip, bzip2
+# Compare compression ratio, speed and binary footprint of different tools
+# Tools: lz77 (this project, as mzip), lz4, gzip, zstd, bzip2; missing tools
+# are skipped
 
 set -e
 
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
 DATASET_DIR="${PROJECT_ROOT}/tests/dataset"
+MZIP="${PROJECT_ROOT}/tools/mzip"
+MUNZIP="${PROJECT_ROOT}/tools/munzip"
 
 # Colors
 RED='\033[0;31m'
@@ -20,6 +23,16 @@ log_info()
     echo -e "${GREEN}[INFO]${NC} $1"
 }
 
+log_warn()
+{
+    echo -e "${YELLOW}[WARN]${NC} $1"
+}
+
+log_error()
+{
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
 log_section()
 {
     echo -e "\n${BLUE}========================================${NC}"
@@ -27,6 +40,60 @@ log_section()
     echo -e "${BLUE}========================================${NC}\n"
 }
 
+usage()
+{
+    cat << EOF
+Usage: $0 [options] [file...]
+
+Compresses and decompresses every file with mzip and each installed tool
+among lz4, gzip, zstd and bzip2 at their default levels. Reports the ratio
+(compressed size in percent of the original, lower is better) and the
+compress and decompress MB/s of the median of several runs. Also gives each
+tool's binary size and the size of the compression libraries it links, all
+measured with stat. Outputs are checked to round-trip. Files default to a
+selection from tests/dataset.
+
+Options:
+  -r N      runs per measurement, the median is reported (default: 3)
+  -j N      mzip/munzip threads (default: 1, like the other tools)
+  -o FILE   also write the results as CSV to FILE
+  -h        show this help
+EOF
+}
+
+RUNS=3
+JOBS=1
+CSV=""
+
+while getopts "r:j:o:h" opt; do
+    case $opt in
+        r) RUNS="$OPTARG" ;;
+        j) JOBS="$OPTARG" ;;
+        o) CSV="$OPTARG" ;;
+        h)
+            usage
+            exit 0
+            ;;
+        *)
+            usage
+            exit 1
+            ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+for value in "$RUNS" "$JOBS"; do
+    if ! [[ "$value" =~ ^[1-9][0-9]*$ ]]; then
+        log_error "Invalid count: $value"
+        exit 1
+    fi
+done
+
+if [ ! -x "$MZIP" ]; then
+    log_error "mzip not found. Run 'make' first."
+    exit 1
+fi
+
 # Test files selection
 TEST_FILES=(
     "canterbury/alice29.txt"
@@ -40,127 +107,221 @@ TEST_FILES=(
     "enwik/enwik8.txt"
 )
 
-# Create temp directory
+FILES=()
+if [ $# -gt 0 ]; then
+    for f in "$@"; do
+        if [ ! -f "$f" ]; then
+            log_error "Input not found: $f"
+            exit 1
+        fi
+        FILES+=("$(cd "$(dirname "$f")" && pwd)/$(basename "$f")")
+    done
+else
+    for f in "${TEST_FILES[@]}"; do
+        [ -f "${DATASET_DIR}/$f" ] && FILES+=("${DATASET_DIR}/$f")
+    done
+    if [ ${#FILES[@]} -eq 0 ]; then
+        log_error "No datasets found. Run 'make dataset' first."
+        exit 1
+    fi
+fi
+
+TOOLS=(lz77)
+for tool in lz4 gzip zstd bzip2; do
+    if command -v "$tool" > /dev/null 2>&1; then
+        TOOLS+=("$tool")
+    else
+        log_warn "$tool not installed, skipped"
+    fi
+done
+
 TEMP_DIR=$(mktemp -d)
 trap "rm -rf $TEMP_DIR" EXIT
 
-log_section "BINARY SIZE COMPARISON"
+# Size in bytes, GNU or BSD stat
+file_size()
+{
+    stat -c %s "$1" 2> /dev/null || stat -f %z "$1"
+}
 
-echo "Tool                Binary    Dynamic Libraries               Total (est.)"
-echo "----                ------    -----------------               ------------"
-printf "lz77 (mzip)         50K       libSystem only                 50K\n"
-printf "lz4                 248K      libSystem only                 248K\n"
-printf "gzip                168K      libbz2, liblzma, libz          ~512K\n"
-printf "bzip2               165K      libbz2                         ~228K\n"
+if [ "$(date +%N)" != "N" ]; then
+    now_ns()
+    {
+        date +%s%N
+    }
+else
+    now_ns()
+    {
+        perl -MTime::HiRes=time -e 'printf "%d\n", time * 1e9'
+    }
+fi
 
-echo ""
-echo "Library sizes (typical):"
-echo "  libbz2:  ~63K  (bzip2 compression)"
-echo "  liblzma: ~181K (xz/lzma compression)"
-echo "  libz:    ~100K (zlib/deflate compression)"
-echo ""
-echo "Note: gzip binary includes support for multiple formats (gzip/bzip2/xz)"
-echo "      via dynamic linking to system libraries."
+tool_binary()
+{
+    case $1 in
+        lz77) echo "$MZIP" ;;
+        *) command -v "$1" ;;
+    esac
+}
 
-log_section "COMPRESSION RATIO COMPARISON"
+# compress <tool> <input> <output>
+compress()
+{
+    case $1 in
+        lz77) (cd "$(dirname "$2")" && "$MZIP" -j "$JOBS" "$(basename "$2")" "$3") ;;
+        lz4) lz4 -q -f "$2" "$3" ;;
+        gzip) gzip -c "$2" > "$3" ;;
+        zstd) zstd -q -f "$2" -o "$3" ;;
+        bzip2) bzip2 -c "$2" > "$3" ;;
+    esac
+}
 
-printf "%-30s %12s %12s %12s %12s %12s\n" "File" "Original" "lz77" "lz4" "gzip" "bzip2"
-printf "%-30s %12s %12s %12s %12s %12s\n" "----" "--------" "----" "---" "----" "-----"
+# decompress <tool> <archive> <output>; munzip extracts the member by name
+decompress()
+{
+    case $1 in
+        lz77) (cd "$(dirname "$3")" && "$MUNZIP" -j "$JOBS" "$2") ;;
+        lz4) lz4 -d -q -f "$2" "$3" ;;
+        gzip) gzip -dc "$2" > "$3" ;;
+        zstd) zstd -d -q -f "$2" -o "$3" ;;
+        bzip2) bzip2 -dc "$2" > "$3" ;;
+    esac
+}
 
-total_original=0
-total_lz77=0
-total_lz4=0
-total_gzip=0
-total_bzip2=0
+# median of the arguments
+median()
+{
+    printf "%s\n" "$@" | sort -g | awk '{v[NR] = $1} END {print v[int((NR + 1) / 2)]}'
+}
 
-for file in "${TEST_FILES[@]}"; do
-    filepath="${DATASET_DIR}/${file}"
+mb_per_s()
+{
+    awk -v b="$1" -v ns="$2" 'BEGIN {printf "%.1f", (ns > 0 ? b * 1000 / ns : 0)}'
+}
 
-    if [ ! -f "$filepath" ]; then
-        continue
+ratio()
+{
+    awk -v c="$1" -v o="$2" 'BEGIN {printf "%.2f", (o > 0 ? 100 * c / o : 0)}'
+}
+
+# Binary size, and the shared libraries it needs besides the C runtime
+# (sizes of their real files)
+measure_binary()
+{
+    local bin=$1 libs=0 names="" lib path
+    bin=$(readlink -f "$bin" 2> /dev/null || echo "$bin")
+    BIN_SIZE=$(file_size "$bin")
+    if command -v ldd > /dev/null 2>&1; then
+        while read -r lib path; do
+            case $lib in
+                linux-vdso* | ld-linux* | libc.so* | libm.so* | libpthread.so* | libdl.so* | librt.so*)
+                    continue
+                    ;;
+            esac
+            [ -f "$path" ] || continue
+            libs=$((libs + $(file_size "$(readlink -f "$path")")))
+            names="${names:+$names }${lib%%.so*}"
+        done < <(ldd "$bin" 2> /dev/null | awk '$2 == "=>" {print $1, $3}')
+    elif command -v otool > /dev/null 2>&1; then
+        while read -r path; do
+            case $path in
+                /usr/lib/libSystem* | /System/*) continue ;;
+            esac
+            [ -f "$path" ] || continue
+            libs=$((libs + $(file_size "$path")))
+            lib=$(basename "$path")
+            names="${names:+$names }${lib%%.*}"
+        done < <(otool -L "$bin" | awk 'NR > 1 {print $1}')
     fi
+    LIB_SIZE=$libs
+    LIB_NAMES=${names:-none}
+}
 
-    # Get original size
-    original_size=$(stat -f%z "$filepath")
-    total_original=$((total_original + original_size))
-
-    # Compress with lz77
-    "${PROJECT_ROOT}/tools/mzip" "$filepath" "${TEMP_DIR}/test.mz" 2> /dev/null
-    lz77_size=$(stat -f%z "${TEMP_DIR}/test.mz")
-    total_lz77=$((total_lz77 + lz77_size))
-    lz77_ratio=$(echo "scale=2; $lz77_size * 100 / $original_size" | bc)
-    rm -f "${TEMP_DIR}/test.mz"
-
-    # Compress with lz4
-    lz4 -q "$filepath" "${TEMP_DIR}/test.lz4" 2> /dev/null
-    lz4_size=$(stat -f%z "${TEMP_DIR}/test.lz4")
-    total_lz4=$((total_lz4 + lz4_size))
-    lz4_ratio=$(echo "scale=2; $lz4_size * 100 / $original_size" | bc)
-    rm -f "${TEMP_DIR}/test.lz4"
-
-    # Compress with gzip
-    gzip -c "$filepath" > "${TEMP_DIR}/test.gz" 2> /dev/null
-    gzip_size=$(stat -f%z "${TEMP_DIR}/test.gz")
-    total_gzip=$((total_gzip + gzip_size))
-    gzip_ratio=$(echo "scale=2; $gzip_size * 100 / $original_size" | bc)
-    rm -f "${TEMP_DIR}/test.gz"
-
-    # Compress with bzip2
-    bzip2 -c "$filepath" > "${TEMP_DIR}/test.bz2" 2> /dev/null
-    bzip2_size=$(stat -f%z "${TEMP_DIR}/test.bz2")
-    total_bzip2=$((total_bzip2 + bzip2_size))
-    bzip2_ratio=$(echo "scale=2; $bzip2_size * 100 / $original_size" | bc)
-    rm -f "${TEMP_DIR}/test.bz2"
-
-    # Format sizes for display
-    orig_fmt=$(numfmt --to=iec-i --suffix=B $original_size 2> /dev/null || echo "${original_size}B")
-    lz77_fmt=$(numfmt --to=iec-i --suffix=B $lz77_size 2> /dev/null || echo "${lz77_size}B")
-    lz4_fmt=$(numfmt --to=iec-i --suffix=B $lz4_size 2> /dev/null || echo "${lz4_size}B")
-    gzip_fmt=$(numfmt --to=iec-i --suffix=B $gzip_size 2> /dev/null || echo "${gzip_size}B")
-    bzip2_fmt=$(numfmt --to=iec-i --suffix=B $bzip2_size 2> /dev/null || echo "${bzip2_size}B")
-
-    printf "%-30s %10s %9s(%2.0f%%) %9s(%2.0f%%) %9s(%2.0f%%) %9s(%2.0f%%)\n" \
-        "$file" "$orig_fmt" \
-        "$lz77_fmt" "$lz77_ratio" \
-        "$lz4_fmt" "$lz4_ratio" \
-        "$gzip_fmt" "$gzip_ratio" \
-        "$bzip2_fmt" "$bzip2_ratio"
+human()
+{
+    numfmt --to=iec-i --suffix=B "$1" 2> /dev/null || echo "${1}B"
+}
+
+# Footprint columns are only filled on each tool's TOTAL row
+[ -n "$CSV" ] && echo "tool,file,size,compressed,ratio_pct,compress_mb_s,decompress_mb_s,binary_bytes,library_bytes,libraries" > "$CSV"
+
+log_info "Tools: ${TOOLS[*]}; median of ${RUNS} run(s); mzip with ${JOBS} thread(s)"
+
+log_section "COMPRESSION RATIO AND SPEED"
+
+printf "%-26s %-6s %12s %12s %8s %10s %10s\n" "File" "Tool" "Original" \
+    "Compressed" "Ratio" "Comp MB/s" "Dec MB/s"
+
+declare -A TOTAL_COMP TOTAL_CTIME TOTAL_DTIME
+total_original=0
+for file in "${FILES[@]}"; do
+    name=${file#"${DATASET_DIR}/"}
+    original=$(file_size "$file")
+    total_original=$((total_original + original))
+    first=1
+
+    for tool in "${TOOLS[@]}"; do
+        archive="$TEMP_DIR/archive"
+        mkdir -p "$TEMP_DIR/out"
+        output="$TEMP_DIR/out/$(basename "$file")"
+        ctimes=() dtimes=()
+        for r in $(seq "$RUNS"); do
+            rm -f "$archive" "$output"
+            start=$(now_ns)
+            compress "$tool" "$file" "$archive" > /dev/null 2>&1 || {
+                log_error "$tool failed to compress $name"
+                exit 1
+            }
+            end=$(now_ns)
+            ctimes+=($((end - start)))
+
+            start=$(now_ns)
+            decompress "$tool" "$archive" "$output" > /dev/null 2>&1 || {
+                log_error "$tool failed to decompress $name"
+                exit 1
+            }
+            end=$(now_ns)
+            dtimes+=($((end - start)))
+        done
+        if ! cmp -s "$file" "$output"; then
+            log_error "$tool does not round-trip $name"
+            exit 1
+        fi
+
+        compressed=$(file_size "$archive")
+        ctime=$(median "${ctimes[@]}")
+        dtime=$(median "${dtimes[@]}")
+        TOTAL_COMP[$tool]=$((${TOTAL_COMP[$tool]:-0} + compressed))
+        TOTAL_CTIME[$tool]=$((${TOTAL_CTIME[$tool]:-0} + ctime))
+        TOTAL_DTIME[$tool]=$((${TOTAL_DTIME[$tool]:-0} + dtime))
+
+        printf "%-26s %-6s %12s %12s %7s%% %10s %10s\n" \
+            "$([ $first -eq 1 ] && echo "$name")" "$tool" \
+            "$([ $first -eq 1 ] && human "$original")" "$(human "$compressed")" \
+            "$(ratio "$compressed" "$original")" \
+            "$(mb_per_s "$original" "$ctime")" "$(mb_per_s "$original" "$dtime")"
+        [ -n "$CSV" ] && echo "$tool,$name,$original,$compressed,$(ratio "$compressed" "$original"),$(mb_per_s "$original" "$ctime"),$(mb_per_s "$original" "$dtime"),,," >> "$CSV"
+        first=0
+    done
+done
+
+log_section "TOTALS AND FOOTPRINT"
+
+printf "%-6s %12s %8s %10s %10s %10s %10s  %s\n" "Tool" "Compressed" "Ratio" \
+    "Comp MB/s" "Dec MB/s" "Binary" "Libraries" "Linked libraries"
+for tool in "${TOOLS[@]}"; do
+    measure_binary "$(tool_binary "$tool")"
+    printf "%-6s %12s %7s%% %10s %10s %10s %10s  %s\n" "$tool" \
+        "$(human "${TOTAL_COMP[$tool]}")" \
+        "$(ratio "${TOTAL_COMP[$tool]}" "$total_original")" \
+        "$(mb_per_s "$total_original" "${TOTAL_CTIME[$tool]}")" \
+        "$(mb_per_s "$total_original" "${TOTAL_DTIME[$tool]}")" \
+        "$(human "$BIN_SIZE")" "$(human "$LIB_SIZE")" "$LIB_NAMES"
+    [ -n "$CSV" ] && echo "$tool,TOTAL,$total_original,${TOTAL_COMP[$tool]},$(ratio "${TOTAL_COMP[$tool]}" "$total_original"),$(mb_per_s "$total_original" "${TOTAL_CTIME[$tool]}"),$(mb_per_s "$total_original" "${TOTAL_DTIME[$tool]}"),$BIN_SIZE,$LIB_SIZE,$LIB_NAMES" >> "$CSV"
 done
 
-log_section "TOTAL STATISTICS"
-
-total_lz77_ratio=$(echo "scale=2; $total_lz77 * 100 / $total_original" | bc)
-total_lz4_ratio=$(echo "scale=2; $total_lz4 * 100 / $total_original" | bc)
-total_gzip_ratio=$(echo "scale=2; $total_gzip * 100 / $total_original" | bc)
-total_bzip2_ratio=$(echo "scale=2; $total_bzip2 * 100 / $total_original" | bc)
-
-orig_total_fmt=$(numfmt --to=iec-i --suffix=B $total_original 2> /dev/null || echo "${total_original}B")
-lz77_total_fmt=$(numfmt --to=iec-i --suffix=B $total_lz77 2> /dev/null || echo "${total_lz77}B")
-lz4_total_fmt=$(numfmt --to=iec-i --suffix=B $total_lz4 2> /dev/null || echo "${total_lz4}B")
-gzip_total_fmt=$(numfmt --to=iec-i --suffix=B $total_gzip 2> /dev/null || echo "${total_gzip}B")
-bzip2_total_fmt=$(numfmt --to=iec-i --suffix=B $total_bzip2 2> /dev/null || echo "${total_bzip2}B")
-
-printf "%-30s %10s %9s(%2.0f%%) %9s(%2.0f%%) %9s(%2.0f%%) %9s(%2.0f%%)\n" \
-    "TOTAL" "$orig_total_fmt" \
-    "$lz77_total_fmt" "$total_lz77_ratio" \
-    "$lz4_total_fmt" "$total_lz4_ratio" \
-    "$gzip_total_fmt" "$total_gzip_ratio" \
-    "$bzip2_total_fmt" "$total_bzip2_ratio"
-
-log_section "SUMMARY"
-
-echo "Compression Ratio (lower is better):"
-echo "  lz77 (this project): ${total_lz77_ratio}%"
-echo "  lz4:                 ${total_lz4_ratio}%"
-echo "  gzip:                ${total_gzip_ratio}%"
-echo "  bzip2:               ${total_bzip2_ratio}%"
-echo ""
-echo "Total Size Including Dependencies (smaller is better):"
-echo "  lz77 (mzip):  50K  (no compression library dependencies)"
-echo "  lz4:          248K (no compression library dependencies)"
-echo "  bzip2:        ~228K (165K binary + ~63K libbz2)"
-echo "  gzip:         ~512K (168K binary + ~344K libraries)"
 echo ""
-echo "Key Insight: lz77 achieves smallest total footprint with zero"
-echo "             compression library dependencies, making it ideal"
-echo "             for embedded systems and minimal installations."
+echo "Speeds include process startup and file I/O, as a user of each tool sees"
+echo "them; mzip output also carries per-chunk headers and checksums."
+[ -n "$CSV" ] && log_info "CSV written to $CSV"
+exit 0
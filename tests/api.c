@@ -3,6 +3,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Built twice: as api against the default header, and as api-stats with
+ * LZ77_ENABLE_STATS, which adds the statistics test
+ */
 #include "lz77.h"
 
 #define TEST_PASSED "\033[32mPASS\033[0m"
@@ -328,6 +331,168 @@ static int test_transitive_repeated_pattern(void)
     return 0;
 }
 
+/* Streaming tests: blocks compressed against the history of earlier ones */
+LZ77_TEST_CASE(stream_continue_roundtrip, test_stream_continue_roundtrip)
+static int test_stream_continue_roundtrip(void)
+{
+    /* small messages, each flushed as its own block, sharing one buffer */
+    const char *message = "{\"method\":\"get\",\"key\":\"user:%04d\"}";
+    const int count = 400;
+    static struct lz77_stream stream;
+    static uint8_t input[64 * 1024], decoded[64 * 1024];
+    static uint8_t blocks[400][128];
+    int lengths[400], sizes[400], total = 0, compressed = 0;
+
+    lz77_stream_init(&stream);
+    for (int i = 0; i < count; i++) {
+        lengths[i] =
+            snprintf((char *) input + total, 64, message, i * 7919 % 10000);
+        sizes[i] = lz77_compress_continue(&stream, input + total, lengths[i],
+                                          blocks[i]);
+        ASSERT_TRUE(sizes[i] > 0 && sizes[i] < 128);
+        total += lengths[i];
+        compressed += sizes[i];
+    }
+
+    /* cross-message history must beat compressing messages one by one */
+    ASSERT_TRUE(compressed < total / 2);
+
+    int out = 0;
+    for (int i = 0; i < count; i++) {
+        int history = out < MAX_DISTANCE ? out : MAX_DISTANCE;
+        int n = lz77_decompress_continue(blocks[i], sizes[i], decoded + out,
+                                         lengths[i], history);
+        ASSERT_INT_EQUALS(lengths[i], n);
+        out += n;
+    }
+    ASSERT_BIN_ARRAYS_EQUALS(input, total, decoded, out);
+    return 0;
+}
+
+LZ77_TEST_CASE(stream_history_bounds, test_stream_history_bounds)
+static int test_stream_history_bounds(void)
+{
+    const char *text = "history bounds are checked by the decoder ";
+    const int len = strlen(text);
+    static struct lz77_stream stream;
+    uint8_t input[128], block[128], decoded[128];
+
+    lz77_stream_init(&stream);
+    memcpy(input, text, len);
+    memcpy(input + len, text, len);
+    lz77_compress_continue(&stream, input, len, block);
+    int size = lz77_compress_continue(&stream, input + len, len, block);
+    ASSERT_TRUE(size > 0 && size < len / 2);
+
+    /* the second block refers into the first one */
+    memcpy(decoded, text, len);
+    ASSERT_INT_EQUALS(0, lz77_decompress(block, size, decoded + len, len));
+    ASSERT_INT_EQUALS(0, lz77_decompress_continue(block, size, decoded + len,
+                                                  len, len / 2));
+    ASSERT_INT_EQUALS(len, (int) lz77_decompress_continue(
+                               block, size, decoded + len, len, len));
+    ASSERT_BIN_ARRAYS_EQUALS(text, len, decoded + len, len);
+
+    /* a reset stream no longer refers back */
+    lz77_stream_init(&stream);
+    size = lz77_compress_continue(&stream, input + len, len, block);
+    ASSERT_INT_EQUALS(len, lz77_decompress(block, size, decoded, len));
+    return 0;
+}
+
+LZ77_TEST_CASE(stream_rebase, test_stream_rebase)
+static int test_stream_rebase(void)
+{
+    /* Two streams over the same data, one about to run out of positions as
+     * after days of traffic: rebasing must not change a single output byte.
+     */
+    static const char *words[] = {"alpha ", "beta ", "gamma ", "delta ",
+                                  "epsilon ", "zeta ", "eta ", "theta "};
+    static struct lz77_stream fresh, aged;
+    static uint8_t input[256 * 1024], decoded[256 * 1024];
+    static uint8_t block_fresh[4096 + 4096 / 32 + COMPRESS_OVERHEAD];
+    static uint8_t block_aged[sizeof(block_fresh)];
+    const size_t block = 4096;
+    uint32_t state = 1;
+
+    for (size_t len = 0; len < sizeof(input);) {
+        state = state * 1103515245u + 12345u;
+        const char *w = words[(state >> 16) & 7];
+        for (; *w && len < sizeof(input); w++)
+            input[len++] = (state >> 24) < 16 ? (uint8_t) (state >> 8) : *w;
+    }
+
+    lz77_stream_init(&fresh);
+    lz77_stream_init(&aged);
+    fresh.position = 1u << 28;
+    aged.position = UINT32_MAX - 20000;
+
+    size_t out = 0;
+    for (size_t off = 0; off < sizeof(input); off += block) {
+        size_t a = lz77_compress_continue(&fresh, input + off, block,
+                                          block_fresh);
+        size_t b = lz77_compress_continue(&aged, input + off, block,
+                                          block_aged);
+        ASSERT_BIN_ARRAYS_EQUALS(block_fresh, a, block_aged, b);
+
+        size_t history = out < MAX_DISTANCE ? out : MAX_DISTANCE;
+        ASSERT_TRUE(lz77_decompress_continue(block_aged, b, decoded + out,
+                                             block, history) == block);
+        out += block;
+    }
+    ASSERT_TRUE(aged.position < 2 * MAX_DISTANCE + sizeof(input));
+    ASSERT_BIN_ARRAYS_EQUALS(input, sizeof(input), decoded, out);
+    return 0;
+}
+
+#ifdef LZ77_ENABLE_STATS
+LZ77_TEST_CASE(compress_stats, test_compress_stats)
+static int test_compress_stats(void)
+{
+    static uint8_t input[64 * 1024], plain[sizeof(input) + 2048],
+        counted[sizeof(plain)];
+    static uint32_t workmem[LZ77_WORKMEM_SIZE / sizeof(uint32_t)];
+    struct lz77_stats stats;
+    uint32_t state = 7;
+
+    /* runs long enough to split both literals and matches */
+    for (size_t i = 0; i < sizeof(input); i++) {
+        state = state * 1103515245u + 12345u;
+        input[i] = (i / 1024) % 2 ? 'z' : (uint8_t) (state >> 16);
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    int a = lz77_compress(input, sizeof(input), plain, workmem);
+    int b = lz77_compress_stats(input, sizeof(input), counted, workmem, &stats);
+    ASSERT_BIN_ARRAYS_EQUALS(plain, a, counted, b);
+
+    ASSERT_TRUE(stats.blocks == 1 && stats.output_bytes == (uint64_t) b);
+    ASSERT_TRUE(stats.literal_bytes + stats.match_bytes == sizeof(input));
+    ASSERT_TRUE(stats.literal_runs > 0 && stats.matches > 0);
+    ASSERT_TRUE(stats.literal_split_bytes > 0 && stats.match_split_bytes > 0);
+
+    uint64_t lengths = 0, distances = 0;
+    for (int i = 0; i < LZ77_STATS_BUCKETS; i++) {
+        lengths += stats.match_length[i];
+        distances += stats.match_distance[i];
+    }
+    ASSERT_TRUE(lengths == stats.matches && distances == stats.matches);
+    ASSERT_TRUE(stats.match_length[0] == 0); /* matches are 3+ bytes */
+
+    ASSERT_TRUE(stats.probes == stats.probe_out_of_window +
+                                    stats.probe_collisions +
+                                    stats.probe_matches);
+    ASSERT_TRUE(stats.probe_matches >= stats.matches);
+    ASSERT_TRUE(stats.table_slots == HASH_SIZE);
+    ASSERT_TRUE(stats.table_used > 0 && stats.table_used <= HASH_SIZE);
+
+    /* totals accumulate across calls */
+    lz77_compress_stats(input, sizeof(input), counted, workmem, &stats);
+    ASSERT_TRUE(stats.blocks == 2 && stats.input_bytes == 2 * sizeof(input));
+    return 0;
+}
+#endif
+
 /* Test registration table */
 static struct test_case *s_tests[] = {
     &s_test_compress_decompress_empty,
@@ -342,6 +507,12 @@ static struct test_case *s_tests[] = {
     &s_test_decompress_output_validation,
     &s_test_transitive_all_chars,
     &s_test_transitive_repeated_pattern,
+    &s_test_stream_continue_roundtrip,
+    &s_test_stream_history_bounds,
+    &s_test_stream_rebase,
+#ifdef LZ77_ENABLE_STATS
+    &s_test_compress_stats,
+#endif
 };
 
 static const size_t s_num_tests = sizeof(s_tests) / sizeof(s_tests[0]);
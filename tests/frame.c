@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lz77-frame.h"
+
+#define TEST_PASSED "\033[32mPASS\033[0m"
+#define TEST_FAILED "\033[31mFAIL\033[0m"
+
+#define LZ77_TEST_CASE(name, fn) \
+    static int fn(void);         \
+    static struct test_case s_test_##name = {#name, fn};
+
+#define ASSERT_INT_EQUALS(expected, actual)                           \
+    do {                                                              \
+        if ((expected) != (actual)) {                                 \
+            fprintf(stderr, "%s:%d: expected %d, got %d\n", __FILE__, \
+                    __LINE__, (int) (expected), (int) (actual));      \
+            return -1;                                                \
+        }                                                             \
+    } while (0)
+
+#define ASSERT_TRUE(expr)                                              \
+    do {                                                               \
+        if (!(expr)) {                                                 \
+            fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, \
+                    __LINE__, #expr);                                  \
+            return -1;                                                 \
+        }                                                              \
+    } while (0)
+
+struct test_case {
+    const char *name;
+    int (*fn)(void);
+};
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+/* Writer and reader contexts are too large for the stack */
+static struct lz77_frame_writer writer;
+static struct lz77_frame_reader reader;
+
+#define NUM_MESSAGES 64
+#define MAX_MESSAGE (3 * LZ77_FRAME_BLOCK_SIZE)
+
+/* Deterministic message i: mixes text-like runs with random bytes, with sizes
+ * from empty to several blocks.
+ */
+static size_t make_message(unsigned i, uint8_t *buf)
+{
+    uint32_t state = 2654435761u * (i + 1);
+    size_t len = i == 0 ? 0 : (i * 7919u) % MAX_MESSAGE;
+    if (i % 4 == 1)
+        len %= 512; /* plenty of small messages */
+
+    for (size_t k = 0; k < len; k++) {
+        state = state * 1103515245u + 12345u;
+        buf[k] = (i % 3) ? "lz77 frame stream "[k % 18] : state >> 24;
+    }
+    return len;
+}
+
+static int send_all(void *ctx, const void *buf, size_t len)
+{
+    int fd = *(int *) ctx;
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return -1;
+        p += n, len -= n;
+    }
+    return 0;
+}
+
+/* Receiver side: collects bytes and checks each message at its flush point */
+struct receiver {
+    uint8_t *data, *expected;
+    size_t len;
+    unsigned messages;
+    int failed;
+};
+
+static int receive(void *ctx, const void *buf, size_t len, int flush)
+{
+    struct receiver *rx = ctx;
+    if (rx->len + len > MAX_MESSAGE)
+        return -1;
+    memcpy(rx->data + rx->len, buf, len);
+    rx->len += len;
+    if (!flush)
+        return 0;
+
+    size_t expected_len = make_message(rx->messages, rx->expected);
+    if (rx->len != expected_len || memcmp(rx->data, rx->expected, rx->len))
+        rx->failed = 1;
+    rx->messages++;
+    rx->len = 0;
+    return 0;
+}
+
+/* Sender process: one flush per message */
+static int send_messages(int fd, unsigned options)
+{
+    uint8_t *buf = malloc(MAX_MESSAGE);
+    if (!buf)
+        return 1;
+
+    lz77_frame_writer_init(&writer, options, send_all, &fd);
+    for (unsigned i = 0; i < NUM_MESSAGES; i++) {
+        size_t len = make_message(i, buf);
+        /* write in uneven pieces to exercise buffering */
+        for (size_t off = 0; off < len;) {
+            size_t n = (len - off) < 1000 + i ? len - off : 1000 + i;
+            lz77_frame_write(&writer, buf + off, n);
+            off += n;
+        }
+        if (lz77_frame_flush(&writer) != LZ77_FRAME_OK)
+            break;
+    }
+    free(buf);
+    return writer.error != LZ77_FRAME_OK;
+}
+
+static int loopback(unsigned options)
+{
+    int sv[2];
+    ASSERT_TRUE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    pid_t pid = fork();
+    ASSERT_TRUE(pid >= 0);
+    if (pid == 0) {
+        close(sv[0]);
+        int ret = send_messages(sv[1], options);
+        close(sv[1]);
+        _exit(ret);
+    }
+    close(sv[1]);
+
+    struct receiver rx = {
+        .data = malloc(MAX_MESSAGE),
+        .expected = malloc(MAX_MESSAGE),
+    };
+    ASSERT_TRUE(rx.data && rx.expected);
+    lz77_frame_reader_init(&reader, receive, &rx);
+
+    /* read in varying sizes, splitting frames at arbitrary points */
+    uint8_t buf[4096];
+    int status = LZ77_FRAME_OK;
+    for (size_t want = 1;; want = want * 3 % sizeof(buf) + 1) {
+        ssize_t n = read(sv[0], buf, want);
+        if (n <= 0)
+            break;
+        status = lz77_frame_feed(&reader, buf, n);
+        if (status != LZ77_FRAME_OK)
+            break;
+    }
+    close(sv[0]);
+
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    free(rx.data);
+    free(rx.expected);
+
+    ASSERT_INT_EQUALS(LZ77_FRAME_OK, status);
+    ASSERT_TRUE(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+    ASSERT_INT_EQUALS(0, rx.failed);
+    ASSERT_INT_EQUALS(NUM_MESSAGES, rx.messages);
+    ASSERT_INT_EQUALS(0, reader.have);
+    return 0;
+}
+
+LZ77_TEST_CASE(socketpair_loopback, test_socketpair_loopback)
+static int test_socketpair_loopback(void)
+{
+    return loopback(LZ77_FRAME_CHECKSUM);
+}
+
+LZ77_TEST_CASE(socketpair_loopback_no_checksum,
+               test_socketpair_loopback_no_checksum)
+static int test_socketpair_loopback_no_checksum(void)
+{
+    return loopback(0);
+}
+
+LZ77_TEST_CASE(socketpair_loopback_linked, test_socketpair_loopback_linked)
+static int test_socketpair_loopback_linked(void)
+{
+    return loopback(LZ77_FRAME_CHECKSUM | LZ77_FRAME_LINKED);
+}
+
+/* In-memory transport for the single-process tests */
+struct memory_sink {
+    uint8_t buf[4 * LZ77_FRAME_MAX_SIZE];
+    size_t len;
+};
+
+static int append(void *ctx, const void *buf, size_t len)
+{
+    struct memory_sink *sink = ctx;
+    if (sink->len + len > sizeof(sink->buf))
+        return -1;
+    memcpy(sink->buf + sink->len, buf, len);
+    sink->len += len;
+    return 0;
+}
+
+static struct memory_sink sink;
+
+static int count_flushes(void *ctx, const void *buf, size_t len, int flush)
+{
+    (void) buf, (void) len;
+    *(int *) ctx += flush;
+    return 0;
+}
+
+LZ77_TEST_CASE(empty_flush_frame, test_empty_flush_frame)
+static int test_empty_flush_frame(void)
+{
+    int flushes = 0;
+    sink.len = 0;
+    lz77_frame_writer_init(&writer, 0, append, &sink);
+    ASSERT_INT_EQUALS(LZ77_FRAME_OK, lz77_frame_flush(&writer));
+    ASSERT_INT_EQUALS(LZ77_FRAME_HEADER_SIZE, sink.len);
+
+    /* feed one byte at a time */
+    lz77_frame_reader_init(&reader, count_flushes, &flushes);
+    for (size_t i = 0; i < sink.len; i++)
+        ASSERT_INT_EQUALS(LZ77_FRAME_OK,
+                          lz77_frame_feed(&reader, sink.buf + i, 1));
+    ASSERT_INT_EQUALS(1, flushes);
+    return 0;
+}
+
+LZ77_TEST_CASE(incompressible_stored, test_incompressible_stored)
+static int test_incompressible_stored(void)
+{
+    uint8_t data[1000];
+    uint32_t state = 1;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        state = state * 1103515245u + 12345u;
+        data[i] = state >> 24;
+    }
+
+    sink.len = 0;
+    lz77_frame_writer_init(&writer, LZ77_FRAME_CHECKSUM, append, &sink);
+    lz77_frame_write(&writer, data, sizeof(data));
+    ASSERT_INT_EQUALS(LZ77_FRAME_OK, lz77_frame_flush(&writer));
+
+    /* random data costs only the frame header and checksum */
+    ASSERT_INT_EQUALS(LZ77_FRAME_HEADER_SIZE + LZ77_FRAME_CHECKSUM_SIZE +
+                          sizeof(data),
+                      sink.len);
+    ASSERT_INT_EQUALS(0, sink.buf[3] & LZ77_FRAME_COMPRESSED);
+    return 0;
+}
+
+LZ77_TEST_CASE(corrupted_payload, test_corrupted_payload)
+static int test_corrupted_payload(void)
+{
+    uint8_t data[2000];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = "corrupted frame payload "[i % 24];
+
+    int flushes = 0;
+    sink.len = 0;
+    lz77_frame_writer_init(&writer, LZ77_FRAME_CHECKSUM, append, &sink);
+    lz77_frame_write(&writer, data, sizeof(data));
+    lz77_frame_flush(&writer);
+    ASSERT_TRUE(sink.buf[3] & LZ77_FRAME_COMPRESSED);
+
+    /* flip a bit of the stored checksum */
+    sink.buf[LZ77_FRAME_HEADER_SIZE] ^= 1;
+    lz77_frame_reader_init(&reader, count_flushes, &flushes);
+    ASSERT_INT_EQUALS(LZ77_FRAME_ECHECKSUM,
+                      lz77_frame_feed(&reader, sink.buf, sink.len));
+    ASSERT_INT_EQUALS(0, flushes);
+
+    /* errors are sticky */
+    ASSERT_INT_EQUALS(LZ77_FRAME_ECHECKSUM,
+                      lz77_frame_feed(&reader, sink.buf, sink.len));
+    return 0;
+}
+
+/* Delivered bytes of the linked tests, checked against what was sent */
+struct collector {
+    uint8_t data[64 * 1024];
+    size_t len;
+    int flushes;
+};
+
+static int collect(void *ctx, const void *buf, size_t len, int flush)
+{
+    struct collector *c = ctx;
+    if (c->len + len > sizeof(c->data))
+        return -1;
+    memcpy(c->data + c->len, buf, len);
+    c->len += len;
+    c->flushes += flush;
+    return 0;
+}
+
+static struct collector collector;
+
+/* Send small similar messages, one flush each; returns the bytes on the wire */
+static size_t send_small_messages(unsigned options, uint8_t *sent, size_t *len)
+{
+    sink.len = 0;
+    *len = 0;
+    lz77_frame_writer_init(&writer, options, append, &sink);
+    for (int i = 0; i < 200; i++) {
+        int n = snprintf((char *) sent + *len, 128,
+                         "GET /api/v1/items/%d HTTP/1.1\r\nHost: example\r\n"
+                         "Accept: application/json\r\n\r\n",
+                         i * 31);
+        lz77_frame_write(&writer, sent + *len, n);
+        lz77_frame_flush(&writer);
+        *len += n;
+    }
+    return writer.error == LZ77_FRAME_OK ? sink.len : 0;
+}
+
+LZ77_TEST_CASE(linked_small_messages, test_linked_small_messages)
+static int test_linked_small_messages(void)
+{
+    static uint8_t sent[64 * 1024];
+    size_t len;
+
+    size_t independent = send_small_messages(0, sent, &len);
+    size_t linked = send_small_messages(LZ77_FRAME_LINKED, sent, &len);
+    ASSERT_TRUE(independent > 0 && linked > 0);
+
+    /* every message repeats most of the previous one */
+    ASSERT_TRUE(linked * 2 < independent);
+
+    memset(&collector, 0, sizeof(collector));
+    lz77_frame_reader_init(&reader, collect, &collector);
+    ASSERT_INT_EQUALS(LZ77_FRAME_OK,
+                      lz77_frame_feed(&reader, sink.buf, sink.len));
+    ASSERT_INT_EQUALS(200, collector.flushes);
+    ASSERT_TRUE(collector.len == len && !memcmp(collector.data, sent, len));
+
+    /* a reader that missed the history rejects the linked frames */
+    size_t first = LZ77_FRAME_HEADER_SIZE +
+                   (lz77_frame_get32(sink.buf) & 0xffffff);
+    lz77_frame_reader_init(&reader, collect, &collector);
+    ASSERT_INT_EQUALS(LZ77_FRAME_ECORRUPT,
+                      lz77_frame_feed(&reader, sink.buf + first,
+                                      sink.len - first));
+    return 0;
+}
+
+LZ77_TEST_CASE(invalid_header, test_invalid_header)
+static int test_invalid_header(void)
+{
+    int flushes = 0;
+
+    /* raw length beyond the block size */
+    uint8_t oversized[LZ77_FRAME_HEADER_SIZE];
+    lz77_frame_put32(oversized, 16 | (LZ77_FRAME_COMPRESSED << 24));
+    lz77_frame_put32(oversized + 4, LZ77_FRAME_BLOCK_SIZE + 1);
+    lz77_frame_reader_init(&reader, count_flushes, &flushes);
+    ASSERT_INT_EQUALS(LZ77_FRAME_ECORRUPT,
+                      lz77_frame_feed(&reader, oversized, sizeof(oversized)));
+
+    /* unknown flag */
+    uint8_t unknown[LZ77_FRAME_HEADER_SIZE];
+    lz77_frame_put32(unknown, 0x80u << 24);
+    lz77_frame_put32(unknown + 4, 0);
+    lz77_frame_reader_init(&reader, count_flushes, &flushes);
+    ASSERT_INT_EQUALS(LZ77_FRAME_ECORRUPT,
+                      lz77_frame_feed(&reader, unknown, sizeof(unknown)));
+
+    /* stored payload must match the raw length */
+    uint8_t stored[LZ77_FRAME_HEADER_SIZE + 4] = {0};
+    lz77_frame_put32(stored, 4);
+    lz77_frame_put32(stored + 4, 3);
+    lz77_frame_reader_init(&reader, count_flushes, &flushes);
+    ASSERT_INT_EQUALS(LZ77_FRAME_ECORRUPT,
+                      lz77_frame_feed(&reader, stored, sizeof(stored)));
+    return 0;
+}
+
+/* Test registration table */
+static struct test_case *s_tests[] = {
+    &s_test_socketpair_loopback,
+    &s_test_socketpair_loopback_no_checksum,
+    &s_test_socketpair_loopback_linked,
+    &s_test_empty_flush_frame,
+    &s_test_incompressible_stored,
+    &s_test_corrupted_payload,
+    &s_test_linked_small_messages,
+    &s_test_invalid_header,
+};
+
+static const size_t s_num_tests = sizeof(s_tests) / sizeof(s_tests[0]);
+
+static void run_test(struct test_case *test)
+{
+    int result = test->fn();
+    if (result == 0) {
+        printf("%s %s\n", TEST_PASSED, test->name);
+        tests_passed++;
+    } else {
+        printf("%s %s\n", TEST_FAILED, test->name);
+        tests_failed++;
+    }
+}
+
+int main(void)
+{
+    printf("Running LZ77 Frame Tests\n");
+    printf("========================\n");
+
+    for (size_t i = 0; i < s_num_tests; i++)
+        run_test(s_tests[i]);
+
+    printf("========================\n");
+    printf("Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed > 0 ? 1 : 0;
+}
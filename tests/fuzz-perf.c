@@ -0,0 +1,137 @@
+/**
+ * libFuzzer harness for the worst-case work of the LZ77 compressor and
+ * decompressor
+ *
+ * tests/fuzz.c checks that every input is handled correctly; this target
+ * checks that none makes lz77_compress() or lz77_decompress() slow. Every
+ * input is compressed as raw data and decoded as an untrusted compressed
+ * block, and the work counters of lz77.h (LZ77_WORK) are compared with a
+ * bound per byte:
+ *
+ * - Compression: match_len() steps plus hash probes, per input byte. Every
+ *   position is probed once, a match adds two lazy probes, and the scans of
+ *   a match and its two lazy candidates each cover at most the bytes the
+ *   match then skips, so about 5 per byte is the ceiling.
+ * - Decompression: tokens plus memcpy() calls, per input and output byte.
+ *   A token consumes at least one input byte and a copy writes at least one
+ *   output byte, so 1 per byte is the ceiling. Matches at distance 1 reach it
+ *   with one call per byte.
+ *
+ * Counts are deterministic, unlike times under sanitizers or a loaded host.
+ * An input over a bound aborts, and libFuzzer saves it (make fuzz-perf puts
+ * it in tests/perf-corpus, the regression corpus that make fuzz-perf-check
+ * replays). The bounds, in work per 1000 bytes, can be tightened with
+ * -DFUZZ_PERF_COMPRESS_BOUND and -DFUZZ_PERF_DECOMPRESS_BOUND, for instance
+ * once the decoder copies overlapping matches in bulk.
+ *
+ * The work per byte also feeds libFuzzer's extra counters, in buckets up to
+ * the bound, so that inputs doing more work per byte count as new coverage
+ * and the fuzzer climbs towards the worst case.
+ *
+ * Run: ./fuzz-perf -max_len=65536 -timeout=10 corpus/
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Work counters of the current call, filled through LZ77_WORK */
+static struct {
+    uint64_t scan, probe, token, copy, output;
+} g_work;
+
+#define LZ77_WORK(counter, n) (g_work.counter += (uint64_t) (n))
+#include "../lz77.h"
+
+/* Work allowed per 1000 bytes; SLACK absorbs the fixed cost of tiny inputs */
+#ifndef FUZZ_PERF_COMPRESS_BOUND
+#define FUZZ_PERF_COMPRESS_BOUND 6000
+#endif
+#ifndef FUZZ_PERF_DECOMPRESS_BOUND
+#define FUZZ_PERF_DECOMPRESS_BOUND 1000
+#endif
+#define SLACK 16
+
+#define MAX_IN_SIZE (256 * 1024)
+#define MAX_OUT_SIZE (MAX_IN_SIZE + MAX_IN_SIZE / 32 + COMPRESS_OVERHEAD)
+#define MAX_DECOMP_SIZE (4 * 1024 * 1024)
+
+/* Buckets of work per byte from 0 to the bound, per phase */
+#define BUCKETS 32
+
+static uint8_t g_compressed[MAX_OUT_SIZE];
+static uint8_t g_decompressed[MAX_DECOMP_SIZE];
+static uint8_t g_workmem[LZ77_WORKMEM_SIZE];
+
+#ifdef __linux__
+__attribute__((used, section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t g_features[2 * BUCKETS];
+
+/* Highest work per byte seen so far, in thousandths, for the reports */
+static uint64_t g_worst[2];
+
+static const char *const phase_names[] = {"compress", "decompress"};
+
+/* Record the work of one call and abort if it is over the bound, given per
+ * 1000 bytes
+ */
+static void check_work(int phase, uint64_t work, uint64_t bytes, uint64_t bound)
+{
+    uint64_t limit = bound * bytes + SLACK * 1000;
+    uint64_t bucket = work * 1000 * BUCKETS / limit;
+    g_features[phase * BUCKETS +
+               (bucket < BUCKETS ? bucket : BUCKETS - 1)] = 1;
+
+    uint64_t milli = bytes ? work * 1000 / bytes : 0;
+    if (milli > g_worst[phase] && bytes >= SLACK) {
+        g_worst[phase] = milli;
+        fprintf(stderr, "fuzz-perf: worst %s so far %.3f work/byte (%llu / "
+                "%llu bytes)\n", phase_names[phase], milli / 1000.0,
+                (unsigned long long) work, (unsigned long long) bytes);
+    }
+
+    if (work * 1000 > limit) {
+        fprintf(stderr, "fuzz-perf: %s did %llu units of work on %llu bytes, "
+                "bound %.3f per byte\n", phase_names[phase],
+                (unsigned long long) work, (unsigned long long) bytes,
+                bound / 1000.0);
+        abort();
+    }
+}
+
+static void fuzz_compress_work(const uint8_t *data, size_t size)
+{
+    if (size > MAX_IN_SIZE)
+        return;
+
+    memset(&g_work, 0, sizeof(g_work));
+    int r = lz77_compress(data, (int) size, g_compressed, g_workmem);
+    if (r < 0 || r > MAX_OUT_SIZE)
+        __builtin_trap();
+    check_work(0, g_work.scan + g_work.probe, size, FUZZ_PERF_COMPRESS_BOUND);
+}
+
+/* The input itself as an untrusted block, counting the bytes it consumed and
+ * the bytes it wrote before it ended or failed
+ */
+static void fuzz_decompress_work(const uint8_t *data, size_t size)
+{
+    if (size == 0)
+        return;
+
+    memset(&g_work, 0, sizeof(g_work));
+    int r = lz77_decompress(data, (int) size, g_decompressed, MAX_DECOMP_SIZE);
+    if (r < 0 || r > MAX_DECOMP_SIZE || (r && (uint64_t) r != g_work.output))
+        __builtin_trap();
+    check_work(1, g_work.token + g_work.copy, size + g_work.output,
+               FUZZ_PERF_DECOMPRESS_BOUND);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzz_compress_work(data, size);
+    fuzz_decompress_work(data, size);
+    return 0;
+}
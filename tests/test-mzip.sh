@@ -9,9 +9,11 @@ SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
 if [ -f "$SCRIPT_DIR/../tools/mzip" ]; then
     MZIP="$SCRIPT_DIR/../tools/mzip"
     MUNZIP="$SCRIPT_DIR/../tools/munzip"
+    MZGREP="$SCRIPT_DIR/../tools/mzgrep"
 elif [ -f "$SCRIPT_DIR/tools/mzip" ]; then
     MZIP="$SCRIPT_DIR/tools/mzip"
     MUNZIP="$SCRIPT_DIR/tools/munzip"
+    MZGREP="$SCRIPT_DIR/tools/mzgrep"
 else
     echo "Error: Cannot find mzip/munzip tools"
     exit 1
@@ -276,6 +278,286 @@ test_cmdline_args()
     fi
 }
 
+# Test 11: Multi-member archive with central directory
+test_multi_member()
+{
+    echo "Test: Multi-member archive (list and parallel extraction)"
+
+    mkdir -p "$TESTDIR/multi"
+    seq 1 20000 > "$TESTDIR/multi/one.txt"
+    seq 1 60000 > "$TESTDIR/multi/two.txt"
+    : > "$TESTDIR/multi/three.txt"
+
+    if $MZIP "$TESTDIR/multi/one.txt" "$TESTDIR/multi/two.txt" \
+        "$TESTDIR/multi/three.txt" "$TESTDIR/multi.mz" > /dev/null 2>&1; then
+        if ! $MUNZIP -l "$TESTDIR/multi.mz" 2>&1 | grep -q "3 file(s)"; then
+            fail "Multi-member listing incorrect"
+            return
+        fi
+        mkdir -p "$TESTDIR/multi-out"
+        cd "$TESTDIR/multi-out"
+        if $MUNZIP -j 3 ../multi.mz > /dev/null 2>&1 \
+            && diff -q one.txt ../multi/one.txt > /dev/null 2>&1 \
+            && diff -q two.txt ../multi/two.txt > /dev/null 2>&1 \
+            && [ -f three.txt ] && [ ! -s three.txt ]; then
+            pass "Multi-member archive round-trip successful"
+        else
+            fail "Multi-member extraction failed"
+        fi
+        cd - > /dev/null
+    else
+        fail "Multi-member compression failed"
+    fi
+}
+
+# Test 12: Extract selected members only
+test_select_member()
+{
+    echo "Test: Selective member extraction"
+
+    echo "alpha" > "$TESTDIR/alpha.txt"
+    echo "beta" > "$TESTDIR/beta.txt"
+    $MZIP "$TESTDIR/alpha.txt" "$TESTDIR/beta.txt" "$TESTDIR/select.mz" > /dev/null 2>&1
+
+    mkdir -p "$TESTDIR/select-out"
+    cd "$TESTDIR/select-out"
+    if $MUNZIP ../select.mz beta.txt > /dev/null 2>&1 \
+        && [ -f beta.txt ] && [ ! -f alpha.txt ]; then
+        if $MUNZIP ../select.mz missing.txt 2>&1 | grep -q "not found"; then
+            pass "Selective extraction works"
+        else
+            fail "Missing member not reported"
+        fi
+    else
+        fail "Selective extraction failed"
+    fi
+    cd - > /dev/null
+}
+
+# Test 13: Recursive directory ingestion
+test_recursive()
+{
+    echo "Test: Recursive directory compression"
+
+    mkdir -p "$TESTDIR/tree/sub/deeper"
+    seq 1 400000 > "$TESTDIR/tree/large.txt"
+    for i in $(seq 1 50); do
+        echo "small $i" > "$TESTDIR/tree/sub/s$i.txt"
+    done
+    : > "$TESTDIR/tree/sub/deeper/empty"
+
+    if $MZIP -r -j 4 "$TESTDIR/tree/" "$TESTDIR/tree.mz" > /dev/null 2>&1 \
+        && $MZIP -r -j 1 "$TESTDIR/tree" "$TESTDIR/tree1.mz" > /dev/null 2>&1; then
+        if ! cmp -s "$TESTDIR/tree.mz" "$TESTDIR/tree1.mz"; then
+            fail "Archive depends on thread count"
+            return
+        fi
+        mkdir -p "$TESTDIR/tree-out"
+        cd "$TESTDIR/tree-out"
+        if $MUNZIP ../tree.mz > /dev/null 2>&1 \
+            && diff -r tree ../tree > /dev/null 2>&1; then
+            pass "Recursive compression round-trip successful"
+        else
+            fail "Recursive extraction mismatch"
+        fi
+        cd - > /dev/null
+    else
+        fail "Recursive compression failed"
+    fi
+}
+
+# Test 14: Sparse files keep their holes
+test_sparse_file()
+{
+    echo "Test: Sparse file compression and extraction"
+
+    truncate -s 32M "$TESTDIR/sparse.img"
+    seq 1 50000 | dd of="$TESTDIR/sparse.img" bs=4096 seek=2048 conv=notrunc > /dev/null 2>&1
+    cp --sparse=always "$TESTDIR/sparse.img" "$TESTDIR/sparse.img.orig"
+
+    if $MZIP "$TESTDIR/sparse.img" "$TESTDIR/sparse.mz" > /dev/null 2>&1; then
+        rm -f "$TESTDIR/sparse.img"
+        cd "$TESTDIR"
+        if $MUNZIP sparse.mz > /dev/null 2>&1 \
+            && cmp -s sparse.img sparse.img.orig; then
+            # holes must not be densified (32 MiB apparent size)
+            if [ "$(du -k sparse.img | cut -f1)" -lt 16384 ]; then
+                pass "Sparse file round-trip keeps holes"
+            else
+                fail "Sparse file was densified"
+            fi
+        else
+            fail "Sparse file extraction mismatch"
+        fi
+        cd - > /dev/null
+    else
+        fail "Sparse file compression failed"
+    fi
+}
+
+# Test 15: Appending grown files and new members to an archive
+test_append()
+{
+    echo "Test: Appending to an existing archive"
+
+    mkdir -p "$TESTDIR/append"
+    seq 1 50000 > "$TESTDIR/append/app.log"
+    if ! $MZIP "$TESTDIR/append/app.log" "$TESTDIR/append.mz" > /dev/null 2>&1; then
+        fail "Append: initial compression failed"
+        return
+    fi
+    cp "$TESTDIR/append.mz" "$TESTDIR/append.mz.orig"
+    dir_offset=$(tail -c 8 "$TESTDIR/append.mz" | od -An -tu8 | tr -d ' ')
+
+    seq 50001 90000 >> "$TESTDIR/append/app.log"
+    echo "rotated" > "$TESTDIR/append/new.txt"
+    if ! $MZIP -a "$TESTDIR/append/app.log" "$TESTDIR/append/new.txt" \
+        "$TESTDIR/append.mz" > /dev/null 2>&1; then
+        fail "Append to existing archive failed"
+        return
+    fi
+
+    # stored chunks must be left untouched
+    if ! cmp -s -n "$dir_offset" "$TESTDIR/append.mz" "$TESTDIR/append.mz.orig"; then
+        fail "Append rewrote existing chunks"
+        return
+    fi
+
+    mkdir -p "$TESTDIR/append-out"
+    cd "$TESTDIR/append-out"
+    if $MUNZIP ../append.mz > /dev/null 2>&1 \
+        && cmp -s app.log ../append/app.log \
+        && cmp -s new.txt ../append/new.txt; then
+        pass "Appended segments and members extract correctly"
+    else
+        fail "Appended archive extraction mismatch"
+    fi
+    cd - > /dev/null
+
+    # a rewritten file is refused, whether its size changed or not, and the
+    # archive is left as it was
+    cp "$TESTDIR/append.mz" "$TESTDIR/append.mz.orig"
+    tr '0-9' '1-90' < "$TESTDIR/append/app.log" > "$TESTDIR/append/app.tmp"
+    mv "$TESTDIR/append/app.tmp" "$TESTDIR/append/app.log"
+    if $MZIP -a "$TESTDIR/append/app.log" "$TESTDIR/append.mz" > /dev/null 2>&1 \
+        || ! cmp -s "$TESTDIR/append.mz" "$TESTDIR/append.mz.orig"; then
+        fail "Append accepted a rewritten file of the same size"
+        return
+    fi
+    seq 90001 95000 >> "$TESTDIR/append/app.log"
+    if $MZIP -a "$TESTDIR/append/app.log" "$TESTDIR/append.mz" > /dev/null 2>&1 \
+        || ! cmp -s "$TESTDIR/append.mz" "$TESTDIR/append.mz.orig"; then
+        fail "Append accepted a rewritten file that grew"
+        return
+    fi
+    # by default only the last stored chunk is compared; --verify reads all
+    { echo 7; seq 2 95000; } > "$TESTDIR/append/app.log"
+    if $MZIP -a --verify "$TESTDIR/append/app.log" "$TESTDIR/append.mz" \
+        > /dev/null 2>&1 \
+        || ! cmp -s "$TESTDIR/append.mz" "$TESTDIR/append.mz.orig"; then
+        fail "Append --verify accepted a file rewritten at its start"
+        return
+    fi
+    pass "Append refuses rewritten files"
+}
+
+# Test 16: Merging archives without recompression
+test_merge()
+{
+    echo "Test: Merging archives"
+
+    mkdir -p "$TESTDIR/merge/a" "$TESTDIR/merge/b" "$TESTDIR/merge/out"
+    seq 1 40000 > "$TESTDIR/merge/a/shared.log"
+    seq 1 30000 > "$TESTDIR/merge/a/one.txt"
+    seq 40001 60000 > "$TESTDIR/merge/b/shared.log"
+    seq 1 10 > "$TESTDIR/merge/b/two.txt"
+
+    (cd "$TESTDIR/merge/a" && $MZIP shared.log one.txt ../a.mz) > /dev/null 2>&1
+    (cd "$TESTDIR/merge/b" && $MZIP shared.log two.txt ../b.mz) > /dev/null 2>&1
+    cd "$TESTDIR/merge"
+    if $MZIP --merge a.mz b.mz ab.mz > /dev/null 2>&1 \
+        && $MZIP --merge a.mz a-copy.mz > /dev/null 2>&1; then
+        # a single archive is copied byte for byte, and same-name members
+        # are concatenated in merge order
+        cat a/shared.log b/shared.log > shared.expected
+        if ! cmp -s a.mz a-copy.mz; then
+            fail "Merging one archive changed it"
+        elif (cd out && $MUNZIP ../ab.mz > /dev/null 2>&1) \
+            && cmp -s out/shared.log shared.expected \
+            && cmp -s out/one.txt a/one.txt \
+            && cmp -s out/two.txt b/two.txt; then
+            pass "Merged archive extracts correctly"
+        else
+            fail "Merged archive extraction mismatch"
+        fi
+    else
+        fail "Merge failed"
+    fi
+    cd - > /dev/null
+}
+
+# Test 17: Searching archives with mzgrep
+test_mzgrep()
+{
+    echo "Test: Searching archive members"
+
+    # the needle spans the boundary between the first two 128 KiB chunks
+    mkdir -p "$TESTDIR/grep"
+    head -c 131070 /dev/zero | tr '\0' 'a' > "$TESTDIR/grep/big.txt"
+    printf 'NEEDLE' >> "$TESTDIR/grep/big.txt"
+    seq 1 20000 >> "$TESTDIR/grep/big.txt"
+    seq 1 100 > "$TESTDIR/grep/small.txt"
+
+    cd "$TESTDIR/grep"
+    if ! $MZIP big.txt small.txt ../grep.mz > /dev/null 2>&1; then
+        fail "mzgrep: compression failed"
+        cd - > /dev/null
+        return
+    fi
+
+    if [ "$($MZGREP -j 2 NEEDLE ../grep.mz)" = "big.txt:131070" ] \
+        && [ "$($MZGREP -l 19999 ../grep.mz)" = "big.txt" ] \
+        && [ "$($MZGREP -c 9 ../grep.mz small.txt)" = "small.txt:20" ]; then
+        if $MZGREP -q NOT-THERE ../grep.mz; then
+            fail "mzgrep reported a missing pattern"
+        else
+            pass "mzgrep finds occurrences across chunk boundaries"
+        fi
+    else
+        fail "mzgrep output mismatch"
+    fi
+    cd - > /dev/null
+}
+
+# Test 18: Per-chunk trace records
+test_trace()
+{
+    echo "Test: JSON trace output"
+
+    mkdir -p "$TESTDIR/trace/out"
+    seq 1 60000 > "$TESTDIR/trace/data.txt"
+    local size chunks
+    size=$(wc -c < "$TESTDIR/trace/data.txt")
+    chunks=$(((size + 131071) / 131072))
+
+    cd "$TESTDIR/trace"
+    $MZIP --trace=json data.txt trace.mz > mzip.json 2> /dev/null
+    (cd out && $MUNZIP --trace=json -j 2 ../trace.mz) > munzip.json 2> /dev/null
+    # one record per chunk, then a summary covering every byte
+    if [ "$(grep -c '"member":"data.txt"' mzip.json)" = "$chunks" ] \
+        && [ "$(grep -c '"member":"data.txt"' munzip.json)" = "$chunks" ] \
+        && tail -n 1 mzip.json | grep -q "\"summary\":true,\"status\":\"ok\".*\"raw_bytes\":$size," \
+        && tail -n 1 munzip.json | grep -q "\"summary\":true,\"status\":\"ok\".*\"raw_bytes\":$size," \
+        && grep -q '"compress_ns":' mzip.json \
+        && grep -q '"decompress_ns":' munzip.json \
+        && cmp -s data.txt out/data.txt; then
+        pass "Trace has one record per chunk and a summary"
+    else
+        fail "Trace output mismatch"
+    fi
+    cd - > /dev/null
+}
+
 # Run all tests
 test_basic_roundtrip
 test_deep_path
@@ -287,6 +569,14 @@ test_non_mzip_rejection
 test_overwrite_protection
 test_binary_data
 test_cmdline_args
+test_multi_member
+test_select_member
+test_recursive
+test_sparse_file
+test_append
+test_merge
+test_mzgrep
+test_trace
 
 # Summary
 echo ""
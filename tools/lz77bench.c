@@ -0,0 +1,1772 @@
+/* lz77bench: throughput benchmark for lz77_compress() and lz77_decompress()
+ *
+ * Every file is loaded into memory and cut into blocks the way mzip stores
+ * them. Each timed iteration compresses (or decompresses) all blocks of the
+ * file; the iterations give a distribution of which the median and the 99th
+ * percentile are reported, after untimed warm-up iterations.
+ *
+ * With -c, Linux perf_event_open() counters run during the timed passes and
+ * give cycles per byte, IPC and miss rates. Counters that cannot be opened
+ * (containers, virtual machines, perf_event_paranoid) are left out.
+ *
+ * With -m, small messages (RPC bodies) are timed one call at a time instead:
+ * there the fixed costs of a call, such as clearing the hash table, dominate,
+ * and the latency distribution matters more than bulk throughput.
+ *
+ * With -S, one extra untimed pass per file runs lz77_compress_stats() and
+ * reports how the hash table and the match finder behaved on that data.
+ *
+ * With --json, the throughput results are printed as JSON instead of a table,
+ * one file per line, for scripts/bench-check.sh.
+ *
+ * With -C, single blocks are also decompressed right after the caches were
+ * flushed, as when the compressed data arrives from the network or disk and
+ * the output is consumed much later, and again at once for comparison. The
+ * warm passes above keep a file's blocks in cache and overstate that speed.
+ *
+ * With -R, memcpy() and memset() over the same buffers give the bandwidth
+ * roof for each file, and the literal and match copies of its blocks are
+ * replayed on their own to split the decoding time between the copy kernels
+ * and the token loop around them.
+ *
+ * With -P, every file runs under each block size of a list, with independent
+ * and with chained blocks (lz77_compress_continue()). The results go to a CSV
+ * file, and for each file and the total, the configurations on the Pareto
+ * frontier of ratio against compression speed are printed.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define LZ77_ENABLE_STATS
+#include "lz77.h"
+
+/* Same block size as mzip data chunks */
+#define DEFAULT_BLOCK_SIZE (2 * 64 * 1024)
+#define DEFAULT_ITERATIONS 10
+#define DEFAULT_WARMUP 2
+#define MAX_FILE_SIZE (100 * 1024 * 1024)
+
+/* Message mode: distinct messages per size, cut from at most MAX_SOURCE bytes
+ * of the input files or from generated records
+ */
+#define MESSAGE_POOL 256
+#define DEFAULT_MESSAGES 20000
+#define MAX_SOURCE (32 * 1024 * 1024)
+#define MAX_MESSAGE_SIZES 16
+#define MAX_MESSAGE_SIZE (1024 * 1024)
+
+/* Worst-case size of an lz77_compress() block of n bytes */
+#define COMPRESS_BOUND(n) ((n) + (n) / 32 + COMPRESS_OVERHEAD)
+
+/* Cold mode: bytes streamed through before every sample, more than the last
+ * level cache of current server parts, and samples per timed iteration
+ */
+#define COLD_EVICT_SIZE (64 * 1024 * 1024)
+#define COLD_SAMPLES 8
+#define CACHE_LINE 64
+
+/* Pareto mode: block sizes swept by default, 0 = whole file, and at most
+ * how many -B takes; every size is measured independent and chained
+ */
+#define DEFAULT_PARETO_SIZES {4096, 16384, 65536, 131072, 1048576, 0}
+#define DEFAULT_PARETO_NSIZES 6
+#define MAX_PARETO_SIZES 16
+#define MAX_PARETO_POINTS (2 * MAX_PARETO_SIZES)
+
+/* The corpus used by tests/driver, relative to the dataset directory */
+static const char *default_files[] = {
+    "canterbury/alice29.txt",
+    "canterbury/asyoulik.txt",
+    "canterbury/cp.html",
+    "canterbury/fields.c",
+    "canterbury/grammar.lsp",
+    "canterbury/kennedy.xls",
+    "canterbury/lcet10.txt",
+    "canterbury/plrabn12.txt",
+    "canterbury/ptt5",
+    "canterbury/sum",
+    "canterbury/xargs.1",
+    "silesia/dickens",
+    "silesia/osdb",
+    "silesia/reymont",
+    "silesia/samba",
+    "silesia/sao",
+    "silesia/webster",
+    "silesia/x-ray",
+    "silesia/xml",
+    "enwik/enwik8.txt",
+};
+
+struct bench_options {
+    const char *dataset; /* prefix of the default files */
+    size_t block_size;   /* 0 = whole file in one call */
+    int iterations;
+    int warmup;
+    bool counters;
+    bool stats;
+    bool json;
+    bool cold;
+    bool roofline;
+    bool chained; /* blocks compressed as one stream */
+    bool messages;
+    int ncalls; /* message mode: timed calls per size and phase */
+    size_t sizes[MAX_MESSAGE_SIZES];
+    int nsizes;
+    const char *pareto; /* CSV output of the sweep */
+    size_t block_sizes[MAX_PARETO_SIZES];
+    int nblock_sizes;
+};
+
+/* One block of a file: raw bytes at raw_offset, compressed at comp_offset */
+struct bench_block {
+    size_t raw_offset, raw_size;
+    size_t comp_offset, comp_size;
+};
+
+struct bench_file {
+    const char *name;
+    uint8_t *data, *comp, *decomp;
+    size_t size, comp_size;
+    struct bench_block *blocks;
+    size_t nblocks;
+};
+
+/* Hardware counters, in the order of counter_events */
+enum {
+    CTR_CYCLES,
+    CTR_INSTRUCTIONS,
+    CTR_BRANCH_MISSES,
+    CTR_L1D_MISSES,
+    CTR_LLC_MISSES,
+    NCOUNTERS,
+};
+
+/* Counter totals of one phase, averaged over the timed passes */
+struct counter_values {
+    double value[NCOUNTERS];
+    bool valid[NCOUNTERS];
+};
+
+/* Timings of one file, in nanoseconds per pass over all its blocks */
+struct bench_result {
+    uint64_t comp_median, comp_p99, comp_mad;
+    uint64_t decomp_median, decomp_p99, decomp_mad;
+    struct counter_values comp_counters, decomp_counters;
+};
+
+/* Single-block decompression of one file, in picoseconds per byte */
+struct cold_result {
+    size_t nblocks;
+    uint64_t cold_median, cold_p99, warm_median;
+};
+
+/* Bandwidth baselines and copy replays of one file, in nanoseconds per pass */
+struct roofline_result {
+    uint64_t memcpy_median, memset_median;
+    uint64_t literal_median, match_median;
+    size_t literal_bytes, match_bytes;
+};
+
+/* Per-file results kept for the counter and statistics reports */
+struct bench_report {
+    const char *name;
+    size_t size, comp_size;
+    struct bench_result res;
+    struct lz77_stats stats;
+    struct cold_result cold;
+    struct roofline_result roofline;
+};
+
+/* A group of counters read together; fd[i] < 0 when counter i is missing */
+struct perf_group {
+    int fd[NCOUNTERS];
+    uint64_t id[NCOUNTERS];
+    int leader;
+};
+
+#ifdef __linux__
+#define CACHE_READ_MISS(cache)                                     \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} counter_events[NCOUNTERS] = {
+    [CTR_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [CTR_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [CTR_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [CTR_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                        CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    [CTR_LLC_MISSES] = {PERF_TYPE_HW_CACHE,
+                        CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+};
+
+/* Open the counters for this thread, user space only. Returns the number of
+ * counters opened; the group stays disabled until perf_group_start().
+ */
+static int perf_group_open(struct perf_group *g)
+{
+    int opened = 0, err = 0;
+
+    g->leader = -1;
+    for (int i = 0; i < NCOUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.disabled = g->leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        g->fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1,
+                                 g->leader < 0 ? -1 : g->fd[g->leader], 0);
+        if (g->fd[i] < 0) {
+            err = errno;
+            continue;
+        }
+        if (ioctl(g->fd[i], PERF_EVENT_IOC_ID, &g->id[i]) < 0) {
+            err = errno;
+            close(g->fd[i]);
+            g->fd[i] = -1;
+            continue;
+        }
+        if (g->leader < 0)
+            g->leader = i;
+        opened++;
+    }
+
+    if (!opened)
+        fprintf(stderr,
+                "Warning: hardware counters unavailable (%s), "
+                "reporting times only\n",
+                strerror(err));
+    return opened;
+}
+
+static void perf_group_close(struct perf_group *g)
+{
+    if (g->leader < 0)
+        return;
+    for (int i = 0; i < NCOUNTERS; i++)
+        if (g->fd[i] >= 0)
+            close(g->fd[i]);
+    g->leader = -1;
+}
+
+static void perf_group_start(struct perf_group *g)
+{
+    if (g->leader < 0)
+        return;
+    ioctl(g->fd[g->leader], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(g->fd[g->leader], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/* Stop the group and add its counts, scaled for multiplexing, to sum */
+static void perf_group_stop(struct perf_group *g, struct counter_values *sum)
+{
+    if (g->leader < 0)
+        return;
+    ioctl(g->fd[g->leader], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    /* nr, time enabled, time running, then nr {value, id} pairs */
+    uint64_t buf[3 + 2 * NCOUNTERS];
+    ssize_t n = read(g->fd[g->leader], buf, sizeof(buf));
+    if (n < (ssize_t) (3 * sizeof(uint64_t)) || !buf[2])
+        return;
+
+    double scale = (double) buf[1] / (double) buf[2];
+    for (uint64_t k = 0; k < buf[0] && k < NCOUNTERS; k++) {
+        for (int i = 0; i < NCOUNTERS; i++) {
+            if (g->fd[i] >= 0 && g->id[i] == buf[4 + 2 * k]) {
+                sum->value[i] += (double) buf[3 + 2 * k] * scale;
+                sum->valid[i] = true;
+            }
+        }
+    }
+}
+#else
+static int perf_group_open(struct perf_group *g)
+{
+    for (int i = 0; i < NCOUNTERS; i++)
+        g->fd[i] = -1;
+    g->leader = -1;
+    fprintf(stderr,
+            "Warning: hardware counters need Linux, reporting times only\n");
+    return 0;
+}
+
+static void perf_group_close(struct perf_group *g)
+{
+    (void) g;
+}
+
+static void perf_group_start(struct perf_group *g)
+{
+    (void) g;
+}
+
+static void perf_group_stop(struct perf_group *g, struct counter_values *sum)
+{
+    (void) g, (void) sum;
+}
+#endif
+
+static void average_counters(struct counter_values *c, int passes)
+{
+    for (int i = 0; i < NCOUNTERS; i++)
+        c->value[i] /= passes;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank quantile of n sorted samples, in per mille (990 = p99) */
+static uint64_t quantile(const uint64_t *sorted, int n, int permille)
+{
+    int rank = (int) (((int64_t) n * permille + 999) / 1000);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* Median absolute deviation of n sorted samples from their median; the
+ * samples are overwritten
+ */
+static uint64_t median_deviation(uint64_t *sorted, int n, uint64_t median)
+{
+    for (int i = 0; i < n; i++)
+        sorted[i] =
+            sorted[i] > median ? sorted[i] - median : median - sorted[i];
+    qsort(sorted, n, sizeof(uint64_t), compare_u64);
+    return quantile(sorted, n, 500);
+}
+
+static double mb_per_s(size_t bytes, uint64_t ns)
+{
+    return ns ? (double) bytes * 1000.0 / (double) ns : 0.0;
+}
+
+static void free_file(struct bench_file *f)
+{
+    free(f->data);
+    free(f->comp);
+    free(f->decomp);
+    free(f->blocks);
+    memset(f, 0, sizeof(*f));
+}
+
+/* Cut a loaded file into blocks of block_size bytes (0 = one block), with
+ * room for their worst-case compressed size
+ */
+static int layout_blocks(struct bench_file *f, size_t block_size)
+{
+    size_t bs = block_size ? block_size : f->size;
+
+    free(f->comp);
+    free(f->blocks);
+    f->nblocks = (f->size + bs - 1) / bs;
+    f->comp = malloc(f->nblocks * COMPRESS_BOUND(bs));
+    f->blocks = calloc(f->nblocks, sizeof(*f->blocks));
+    if (!f->comp || !f->blocks)
+        return -1;
+
+    for (size_t i = 0; i < f->nblocks; i++) {
+        struct bench_block *b = &f->blocks[i];
+        b->raw_offset = i * bs;
+        b->raw_size = f->size - b->raw_offset < bs ? f->size - b->raw_offset
+                                                   : bs;
+        b->comp_offset = i * COMPRESS_BOUND(bs);
+    }
+    return 0;
+}
+
+/* Load a file and lay out its blocks; returns 0, or -1 if it is skipped */
+static int load_file(struct bench_file *f,
+                     const char *name,
+                     const char *path,
+                     size_t block_size)
+{
+    memset(f, 0, sizeof(*f));
+    f->name = name;
+
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        printf("%-26s [missing]\n", name);
+        return -1;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    if (size <= 0 || size > MAX_FILE_SIZE) {
+        fclose(in);
+        printf("%-26s [skipped, %s]\n", name, size <= 0 ? "empty" : "too big");
+        return -1;
+    }
+
+    f->size = (size_t) size;
+    f->data = malloc(f->size);
+    f->decomp = malloc(f->size);
+    if (!f->data || !f->decomp || layout_blocks(f, block_size) < 0) {
+        fclose(in);
+        free_file(f);
+        fprintf(stderr, "Error: cannot allocate buffers for %s\n", path);
+        return -1;
+    }
+    if (fread(f->data, 1, f->size, in) != f->size) {
+        fclose(in);
+        free_file(f);
+        fprintf(stderr, "Error: cannot read %s\n", path);
+        return -1;
+    }
+    fclose(in);
+    return 0;
+}
+
+/* One pass of compression over all blocks; returns the elapsed time. Chained
+ * blocks go through one stream, workmem then holding a struct lz77_stream.
+ */
+static uint64_t compress_pass(struct bench_file *f, void *workmem, bool chained)
+{
+    uint64_t start = now_ns();
+    size_t total = 0;
+
+    if (chained)
+        lz77_stream_init((struct lz77_stream *) workmem);
+    for (size_t i = 0; i < f->nblocks; i++) {
+        struct bench_block *b = &f->blocks[i];
+        if (chained)
+            b->comp_size = lz77_compress_continue(
+                (struct lz77_stream *) workmem, f->data + b->raw_offset,
+                b->raw_size, f->comp + b->comp_offset);
+        else
+            b->comp_size = (size_t) lz77_compress(
+                f->data + b->raw_offset, (int) b->raw_size,
+                f->comp + b->comp_offset, workmem);
+        total += b->comp_size;
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    f->comp_size = total;
+    return elapsed;
+}
+
+/* One pass of decompression over all blocks; returns the elapsed time, or 0
+ * if a block does not decode to its original size
+ */
+static uint64_t decompress_pass(struct bench_file *f, bool chained)
+{
+    uint64_t start = now_ns();
+    bool ok = true;
+
+    for (size_t i = 0; i < f->nblocks; i++) {
+        const struct bench_block *b = &f->blocks[i];
+        size_t n;
+        if (chained)
+            n = lz77_decompress_continue(
+                f->comp + b->comp_offset, b->comp_size,
+                f->decomp + b->raw_offset, b->raw_size,
+                b->raw_offset < MAX_DISTANCE ? b->raw_offset : MAX_DISTANCE);
+        else
+            n = (size_t) lz77_decompress(f->comp + b->comp_offset,
+                                         (int) b->comp_size,
+                                         f->decomp + b->raw_offset,
+                                         (int) b->raw_size);
+        ok &= n == b->raw_size;
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    return ok ? (elapsed ? elapsed : 1) : 0;
+}
+
+/* Untimed compression pass that collects statistics over all blocks */
+static void stats_pass(struct bench_file *f,
+                       void *workmem,
+                       struct lz77_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < f->nblocks; i++) {
+        const struct bench_block *b = &f->blocks[i];
+        lz77_compress_stats(f->data + b->raw_offset, (int) b->raw_size,
+                            f->comp + b->comp_offset, workmem, stats);
+    }
+}
+
+/* Write one byte per cache line of the eviction buffer: the lines of the
+ * previous sample are displaced, the dirty ones written back
+ */
+static void evict_caches(uint8_t *evict)
+{
+    for (size_t i = 0; i < COLD_EVICT_SIZE; i += CACHE_LINE)
+        evict[i]++;
+}
+
+/* Decompress one block; returns picoseconds per byte, or 0 if it does not
+ * decode to its original size
+ */
+static uint64_t decompress_block(struct bench_file *f,
+                                 const struct bench_block *b)
+{
+    uint64_t start = now_ns();
+    int n = lz77_decompress(f->comp + b->comp_offset, (int) b->comp_size,
+                            f->decomp + b->raw_offset, (int) b->raw_size);
+    uint64_t elapsed = now_ns() - start;
+
+    if ((size_t) n != b->raw_size)
+        return 0;
+    return elapsed ? elapsed * 1000 / b->raw_size : 1;
+}
+
+/* Every sample flushes the caches, decompresses the next block (cold) and the
+ * same block again (warm). Samples rotate through all blocks of the file, so
+ * a file of several blocks never decodes the same data twice in a row cold.
+ * Expects the blocks compressed by bench_file().
+ */
+static int cold_pass(struct bench_file *f,
+                     const struct bench_options *opts,
+                     uint8_t *evict,
+                     struct cold_result *res)
+{
+    int n = opts->iterations * COLD_SAMPLES;
+    uint64_t *cold = calloc(n, sizeof(uint64_t));
+    uint64_t *warm = calloc(n, sizeof(uint64_t));
+    int status = 0;
+
+    memset(res, 0, sizeof(*res));
+    if (!cold || !warm) {
+        fprintf(stderr, "Error: cannot allocate samples\n");
+        status = -1;
+        goto out;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const struct bench_block *b = &f->blocks[i % f->nblocks];
+        evict_caches(evict);
+        cold[i] = decompress_block(f, b);
+        warm[i] = decompress_block(f, b);
+        if (!cold[i] || !warm[i]) {
+            fprintf(stderr, "Error: %s does not round-trip\n", f->name);
+            status = -1;
+            goto out;
+        }
+    }
+
+    qsort(cold, n, sizeof(uint64_t), compare_u64);
+    qsort(warm, n, sizeof(uint64_t), compare_u64);
+    res->nblocks = f->nblocks;
+    res->cold_median = quantile(cold, n, 500);
+    res->cold_p99 = quantile(cold, n, 990);
+    res->warm_median = quantile(warm, n, 500);
+
+out:
+    free(cold);
+    free(warm);
+    return status;
+}
+
+/* One copy of the decoder: len bytes from src (compressed stream for a
+ * literal run, output for a match) to dst in the output
+ */
+struct copy_op {
+    uint32_t dst, src, len;
+};
+
+/* Split the blocks into their literal and match copies, in the layout of
+ * lz77_decompress(); returns the number of copies of each kind, or -1 on a
+ * malformed block
+ */
+static int parse_copies(const struct bench_file *f,
+                        struct copy_op *literals,
+                        size_t *nliterals,
+                        struct copy_op *matches,
+                        size_t *nmatches)
+{
+    *nliterals = *nmatches = 0;
+    for (size_t i = 0; i < f->nblocks; i++) {
+        const struct bench_block *b = &f->blocks[i];
+        if (!b->comp_size)
+            continue;
+
+        const uint8_t *in = f->comp + b->comp_offset;
+        size_t ip = 0, op = b->raw_offset, end = b->raw_offset + b->raw_size;
+        size_t bound = b->comp_size >= 2 ? b->comp_size - 2 : 0;
+        uint32_t ctrl = in[ip++] & 31;
+        while (1) {
+            if (ctrl >= 32) {
+                uint32_t len = (ctrl >> 5) - 1, ofs = (ctrl & 31) << 8;
+                if (len == 6)
+                    len += in[ip++];
+                ofs += in[ip++] + 1;
+                len += 3;
+                if (ofs > op - b->raw_offset || op + len > end)
+                    return -1;
+                matches[(*nmatches)++] = (struct copy_op){op, op - ofs, len};
+                op += len;
+            } else {
+                ctrl++;
+                if (op + ctrl > end)
+                    return -1;
+                literals[(*nliterals)++] = (struct copy_op){
+                    op, (uint32_t) (b->comp_offset + ip), ctrl};
+                ip += ctrl, op += ctrl;
+            }
+            if (ip > bound)
+                break;
+            ctrl = in[ip++];
+        }
+        if (op != end)
+            return -1;
+    }
+    return 0;
+}
+
+static uint64_t replay_literals(struct bench_file *f,
+                                const struct copy_op *ops,
+                                size_t n)
+{
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < n; i++)
+        memcpy(f->decomp + ops[i].dst, f->comp + ops[i].src, ops[i].len);
+    return now_ns() - start;
+}
+
+/* Matches copy in chunks of at most the distance, as the decoder does */
+static uint64_t replay_matches(struct bench_file *f,
+                               const struct copy_op *ops,
+                               size_t n)
+{
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        uint8_t *op = f->decomp + ops[i].dst;
+        const uint8_t *ref = f->decomp + ops[i].src;
+        for (uint32_t remain = ops[i].len, distance = op - ref; remain;) {
+            uint32_t chunk = remain < distance ? remain : distance;
+            memcpy(op, ref, chunk);
+            op += chunk, ref += chunk, remain -= chunk;
+        }
+    }
+    return now_ns() - start;
+}
+
+/* memcpy() and memset() over the buffers of the file; the copy ops are not
+ * used but keep the signature of the replays
+ */
+static uint64_t memcpy_pass(struct bench_file *f,
+                            const struct copy_op *ops,
+                            size_t n)
+{
+    (void) ops, (void) n;
+    uint64_t start = now_ns();
+    memcpy(f->decomp, f->data, f->size);
+    return now_ns() - start;
+}
+
+static uint64_t memset_pass(struct bench_file *f,
+                            const struct copy_op *ops,
+                            size_t n)
+{
+    (void) ops, (void) n;
+    uint64_t start = now_ns();
+    memset(f->decomp, 0, f->size);
+    return now_ns() - start;
+}
+
+/* Median time of a pass over the timed iterations, after the warm-up */
+static uint64_t median_pass(uint64_t (*pass)(struct bench_file *,
+                                             const struct copy_op *,
+                                             size_t),
+                            struct bench_file *f,
+                            const struct copy_op *ops,
+                            size_t n,
+                            const struct bench_options *opts,
+                            uint64_t *samples)
+{
+    for (int i = 0; i < opts->warmup; i++)
+        pass(f, ops, n);
+    for (int i = 0; i < opts->iterations; i++)
+        samples[i] = pass(f, ops, n);
+    qsort(samples, opts->iterations, sizeof(uint64_t), compare_u64);
+    return quantile(samples, opts->iterations, 500);
+}
+
+/* memset() runs first, then memcpy() restores the output, so that the
+ * replayed matches copy the real data. Expects the blocks compressed by
+ * bench_file().
+ */
+static int roofline_pass(struct bench_file *f,
+                         const struct bench_options *opts,
+                         struct roofline_result *res)
+{
+    size_t max_ops = f->comp_size + f->nblocks;
+    struct copy_op *literals = malloc(max_ops * sizeof(*literals));
+    struct copy_op *matches = malloc(max_ops * sizeof(*matches));
+    uint64_t *samples = calloc(opts->iterations, sizeof(uint64_t));
+    size_t nliterals, nmatches;
+    int status = 0;
+
+    memset(res, 0, sizeof(*res));
+    if (!literals || !matches || !samples) {
+        fprintf(stderr, "Error: cannot allocate copy list\n");
+        status = -1;
+        goto out;
+    }
+    if (parse_copies(f, literals, &nliterals, matches, &nmatches) < 0) {
+        fprintf(stderr, "Error: cannot parse the blocks of %s\n", f->name);
+        status = -1;
+        goto out;
+    }
+    for (size_t i = 0; i < nliterals; i++)
+        res->literal_bytes += literals[i].len;
+    for (size_t i = 0; i < nmatches; i++)
+        res->match_bytes += matches[i].len;
+
+    res->memset_median = median_pass(memset_pass, f, NULL, 0, opts, samples);
+    res->memcpy_median = median_pass(memcpy_pass, f, NULL, 0, opts, samples);
+    res->literal_median =
+        median_pass(replay_literals, f, literals, nliterals, opts, samples);
+    res->match_median =
+        median_pass(replay_matches, f, matches, nmatches, opts, samples);
+
+out:
+    free(literals);
+    free(matches);
+    free(samples);
+    return status;
+}
+
+/* Counters, when open, run only around the timed passes: their syscalls stay
+ * outside the measured time.
+ */
+static int bench_file(struct bench_file *f,
+                      const struct bench_options *opts,
+                      void *workmem,
+                      struct perf_group *counters,
+                      struct bench_result *res)
+{
+    memset(res, 0, sizeof(*res));
+
+    uint64_t *comp = calloc(opts->iterations, sizeof(uint64_t));
+    uint64_t *decomp = calloc(opts->iterations, sizeof(uint64_t));
+    if (!comp || !decomp) {
+        free(comp);
+        free(decomp);
+        fprintf(stderr, "Error: cannot allocate samples\n");
+        return -1;
+    }
+
+    for (int i = 0; i < opts->warmup; i++)
+        compress_pass(f, workmem, opts->chained);
+    for (int i = 0; i < opts->iterations; i++) {
+        perf_group_start(counters);
+        comp[i] = compress_pass(f, workmem, opts->chained);
+        perf_group_stop(counters, &res->comp_counters);
+    }
+
+    /* every run ends with a full round-trip check */
+    for (int i = 0; i < opts->warmup; i++)
+        decompress_pass(f, opts->chained);
+    memset(f->decomp, 0, f->size);
+    for (int i = 0; i < opts->iterations; i++) {
+        perf_group_start(counters);
+        decomp[i] = decompress_pass(f, opts->chained);
+        perf_group_stop(counters, &res->decomp_counters);
+        if (!decomp[i] || memcmp(f->data, f->decomp, f->size)) {
+            fprintf(stderr, "Error: %s does not round-trip\n", f->name);
+            free(comp);
+            free(decomp);
+            return -1;
+        }
+    }
+
+    qsort(comp, opts->iterations, sizeof(uint64_t), compare_u64);
+    qsort(decomp, opts->iterations, sizeof(uint64_t), compare_u64);
+    res->comp_median = quantile(comp, opts->iterations, 500);
+    res->comp_p99 = quantile(comp, opts->iterations, 990);
+    res->decomp_median = quantile(decomp, opts->iterations, 500);
+    res->decomp_p99 = quantile(decomp, opts->iterations, 990);
+    res->comp_mad = median_deviation(comp, opts->iterations, res->comp_median);
+    res->decomp_mad =
+        median_deviation(decomp, opts->iterations, res->decomp_median);
+    average_counters(&res->comp_counters, opts->iterations);
+    average_counters(&res->decomp_counters, opts->iterations);
+
+    free(comp);
+    free(decomp);
+    return 0;
+}
+
+static void print_header(void)
+{
+    printf("%-26s %10s %10s %7s %9s %9s %9s %9s\n", "File", "Size",
+           "Compressed", "Ratio", "C med", "C p99", "D med", "D p99");
+}
+
+static void print_row(const char *name,
+                      size_t size,
+                      size_t comp_size,
+                      const struct bench_result *res)
+{
+    printf("%-26s %10zu %10zu %6.2f%% %9.1f %9.1f %9.1f %9.1f\n", name, size,
+           comp_size, 100.0 * (double) comp_size / (double) size,
+           mb_per_s(size, res->comp_median), mb_per_s(size, res->comp_p99),
+           mb_per_s(size, res->decomp_median), mb_per_s(size, res->decomp_p99));
+}
+
+/* One JSON object per line: MB/s at the median and p99 pass, and the median
+ * absolute deviation of the pass times in percent of the median
+ */
+static void print_json_row(const char *key,
+                           const char *name,
+                           size_t size,
+                           size_t comp_size,
+                           const struct bench_result *res,
+                           bool last)
+{
+    printf("  %s{\"name\": \"", key);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            putchar('\\');
+        putchar(*p);
+    }
+    printf("\", \"size\": %zu, \"compressed\": %zu, \"comp_mb_s\": %.2f, "
+           "\"comp_p99_mb_s\": %.2f, \"comp_mad_pct\": %.2f, "
+           "\"decomp_mb_s\": %.2f, \"decomp_p99_mb_s\": %.2f, "
+           "\"decomp_mad_pct\": %.2f}%s\n",
+           size, comp_size, mb_per_s(size, res->comp_median),
+           mb_per_s(size, res->comp_p99),
+           res->comp_median ? 100.0 * (double) res->comp_mad /
+                                  (double) res->comp_median
+                            : 0.0,
+           mb_per_s(size, res->decomp_median), mb_per_s(size, res->decomp_p99),
+           res->decomp_median ? 100.0 * (double) res->decomp_mad /
+                                    (double) res->decomp_median
+                              : 0.0,
+           last ? "" : ",");
+}
+
+static void print_json(const struct bench_options *opts,
+                       const struct bench_report *reports,
+                       int n,
+                       size_t total_size,
+                       size_t total_comp,
+                       const struct bench_result *total)
+{
+    printf("{\n  \"block_size\": %zu, \"iterations\": %d, \"warmup\": %d,\n"
+           "  \"files\": [\n",
+           opts->block_size, opts->iterations, opts->warmup);
+    for (int i = 0; i < n; i++)
+        print_json_row("  ", reports[i].name, reports[i].size,
+                       reports[i].comp_size, &reports[i].res, i == n - 1);
+    printf("  ],\n");
+    print_json_row("\"total\": ", "Total", total_size, total_comp, total,
+                   true);
+    printf("}\n");
+}
+
+/* Counter value per unit, or "-" when the counter did not run */
+static void print_counter(const struct counter_values *c,
+                          int ctr,
+                          double per,
+                          int width)
+{
+    if (c->valid[ctr] && per > 0)
+        printf(" %*.2f", width, c->value[ctr] / per);
+    else
+        printf(" %*s", width, "-");
+}
+
+static void print_counter_row(const char *name,
+                              const char *phase,
+                              size_t size,
+                              const struct counter_values *c)
+{
+    printf("%-26s %-6s", name, phase);
+    print_counter(c, CTR_CYCLES, (double) size, 8);
+    if (c->valid[CTR_CYCLES])
+        print_counter(c, CTR_INSTRUCTIONS, c->value[CTR_CYCLES], 6);
+    else
+        printf(" %6s", "-");
+    print_counter(c, CTR_BRANCH_MISSES, size / 1024.0, 12);
+    print_counter(c, CTR_L1D_MISSES, size / 1024.0, 12);
+    print_counter(c, CTR_LLC_MISSES, size / 1024.0, 12);
+    printf("\n");
+}
+
+static void print_counters(const struct bench_report *reports, int n)
+{
+    printf("\nHardware counters per pass: cycles per byte, instructions per "
+           "cycle,\nmisses per KiB of input\n");
+    printf("%-26s %-6s %8s %6s %12s %12s %12s\n", "File", "Phase", "cyc/B",
+           "IPC", "br-miss/KiB", "L1d-miss/KiB", "LLC-miss/KiB");
+    for (int i = 0; i < n; i++) {
+        print_counter_row(reports[i].name, "comp", reports[i].size,
+                          &reports[i].res.comp_counters);
+        print_counter_row("", "decomp", reports[i].size,
+                          &reports[i].res.decomp_counters);
+    }
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * (double) part / (double) whole : 0.0;
+}
+
+static double ps_to_mb_s(uint64_t ps_per_byte)
+{
+    return ps_per_byte ? 1e6 / (double) ps_per_byte : 0.0;
+}
+
+static void print_cold(const struct bench_report *reports, int n)
+{
+    printf("\nSingle-block decompression in MB/s: cold right after the caches "
+           "were\nflushed, warm when the same block is decompressed again\n");
+    printf("%-26s %7s %9s %9s %9s %7s\n", "File", "Blocks", "Cold med",
+           "Cold p99", "Warm med", "Cold%");
+    for (int i = 0; i < n; i++) {
+        const struct cold_result *c = &reports[i].cold;
+        printf("%-26s %7zu %9.1f %9.1f %9.1f %6.1f%%\n", reports[i].name,
+               c->nblocks, ps_to_mb_s(c->cold_median),
+               ps_to_mb_s(c->cold_p99), ps_to_mb_s(c->warm_median),
+               percent(c->warm_median, c->cold_median));
+    }
+}
+
+/* Decoding speed against the memcpy() roof, and the decoding time split into
+ * the replayed literal and match copies and the rest, the token loop
+ */
+static void print_roofline(const struct bench_report *reports, int n)
+{
+    printf("\nDecompression against memory bandwidth in MB/s, and the share "
+           "of the\ndecoding time in literal copies, match copies and the "
+           "token loop\n");
+    printf("%-26s %9s %9s %9s %8s %7s %7s %7s %7s\n", "File", "memcpy",
+           "memset", "decomp", "%memcpy", "litB%", "lit%", "match%", "loop%");
+    for (int i = 0; i < n; i++) {
+        const struct roofline_result *r = &reports[i].roofline;
+        uint64_t decode = reports[i].res.decomp_median;
+        uint64_t copies = r->literal_median + r->match_median;
+        printf("%-26s %9.1f %9.1f %9.1f %7.1f%% %6.1f%% %6.1f%% %6.1f%% "
+               "%6.1f%%\n",
+               reports[i].name, mb_per_s(reports[i].size, r->memcpy_median),
+               mb_per_s(reports[i].size, r->memset_median),
+               mb_per_s(reports[i].size, decode),
+               percent(r->memcpy_median, decode),
+               percent(r->literal_bytes, reports[i].size),
+               percent(r->literal_median, decode),
+               percent(r->match_median, decode),
+               decode > copies ? percent(decode - copies, decode) : 0.0);
+    }
+}
+
+/* Hash probe outcomes as shares of all probes, fill level as the average share
+ * of slots a block writes, then what the match finder made of it
+ */
+static void print_stats(const struct bench_report *reports, int n)
+{
+    printf("\nCompressor statistics: hash probes per input byte, probe "
+           "outcomes,\ntable fill per block, literal share, average match "
+           "length, lazy matches\n");
+    printf("%-26s %7s %8s %8s %8s %6s %7s %7s %6s\n", "File", "probe/B",
+           "window%", "collide%", "match%", "fill%", "lit%", "avglen",
+           "lazy%");
+    for (int i = 0; i < n; i++) {
+        const struct lz77_stats *st = &reports[i].stats;
+        uint64_t lazy = st->lazy_step1 + st->lazy_step2;
+        printf("%-26s %7.2f %7.1f%% %7.1f%% %7.1f%% %5.1f%% %6.1f%% %7.1f "
+               "%5.1f%%\n",
+               reports[i].name,
+               st->input_bytes
+                   ? (double) st->probes / (double) st->input_bytes
+                   : 0.0,
+               percent(st->probe_out_of_window, st->probes),
+               percent(st->probe_collisions, st->probes),
+               percent(st->probe_matches, st->probes),
+               percent(st->table_used, st->table_slots),
+               percent(st->literal_bytes, st->input_bytes),
+               st->matches ? (double) st->match_bytes / (double) st->matches
+                           : 0.0,
+               percent(lazy, st->matches));
+    }
+}
+
+/* Message mode */
+
+/* Messages of one size: MESSAGE_POOL copies, each with its compressed form */
+struct message_pool {
+    size_t size;
+    uint8_t *raw, *comp, *decomp;
+    size_t comp_size[MESSAGE_POOL];
+    size_t comp_stride;
+};
+
+/* Latency distribution and batch rate of one phase */
+struct message_result {
+    uint64_t p50, p99, p999;
+    double per_second;
+    struct counter_values counters;
+};
+
+/* Synthetic RPC traffic when no input file is available: JSON records with
+ * recurring keys and varying values
+ */
+static size_t generate_source(uint8_t *buf, size_t size)
+{
+    static const char *methods[] = {"get", "put", "list", "delete", "watch"};
+    static const char *regions[] = {"us-east", "eu-west", "ap-south"};
+    uint32_t state = 12345;
+    size_t len = 0;
+
+    while (len + 256 < size) {
+        state = state * 1103515245u + 12345u;
+        uint32_t r = state >> 8;
+        len += (size_t) snprintf(
+            (char *) buf + len, 256,
+            "{\"id\":%u,\"method\":\"%s\",\"key\":\"user/%u/profile\","
+            "\"region\":\"%s\",\"ttl\":%u,\"trace\":\"%08x\"}\n",
+            r & 0xfffff, methods[r % 5], (r >> 4) % 5000, regions[r % 3],
+            (r >> 12) % 3600, state);
+    }
+    return len;
+}
+
+/* Concatenate the input files (up to MAX_SOURCE bytes) as message source */
+static size_t load_source(const struct bench_options *opts,
+                          const char **names,
+                          int nfiles,
+                          bool use_default,
+                          uint8_t *buf)
+{
+    size_t len = 0;
+    int used = 0;
+
+    for (int i = 0; i < nfiles && len < MAX_SOURCE; i++) {
+        char path[4096];
+        if (use_default)
+            snprintf(path, sizeof(path), "%s/%s", opts->dataset, names[i]);
+        else
+            snprintf(path, sizeof(path), "%s", names[i]);
+
+        FILE *in = fopen(path, "rb");
+        if (!in) {
+            if (!use_default)
+                fprintf(stderr, "Warning: cannot open %s\n", path);
+            continue;
+        }
+        len += fread(buf + len, 1, MAX_SOURCE - len, in);
+        fclose(in);
+        used++;
+    }
+
+    if (len >= MAX_MESSAGE_SIZE || (len && !use_default)) {
+        printf("Messages cut from %d file(s), %zu bytes\n", used, len);
+        return len;
+    }
+    printf("Messages cut from generated RPC records\n");
+    return generate_source(buf, MAX_SOURCE);
+}
+
+static int pool_init(struct message_pool *pool,
+                     size_t size,
+                     const uint8_t *source,
+                     size_t source_len,
+                     void *workmem)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->size = size;
+    pool->comp_stride = COMPRESS_BOUND(size);
+    pool->raw = malloc(MESSAGE_POOL * size);
+    pool->comp = malloc(MESSAGE_POOL * pool->comp_stride);
+    pool->decomp = malloc(size);
+    if (!pool->raw || !pool->comp || !pool->decomp)
+        return -1;
+
+    /* messages start at scattered offsets, repeating the source if short */
+    uint32_t state = (uint32_t) size;
+    for (int m = 0; m < MESSAGE_POOL; m++) {
+        state = state * 1103515245u + 12345u;
+        size_t off = source_len > size ? (state >> 4) % (source_len - size) : 0;
+        for (size_t k = 0; k < size; k++)
+            pool->raw[m * size + k] = source[(off + k) % source_len];
+        pool->comp_size[m] = (size_t) lz77_compress(
+            pool->raw + m * size, (int) size,
+            pool->comp + m * pool->comp_stride, workmem);
+    }
+    return 0;
+}
+
+static void pool_free(struct message_pool *pool)
+{
+    free(pool->raw);
+    free(pool->comp);
+    free(pool->decomp);
+}
+
+/* One call on message m; returns the decompressed size for decompression */
+static inline size_t message_call(struct message_pool *pool,
+                                  int m,
+                                  bool decompress,
+                                  void *workmem)
+{
+    if (decompress)
+        return (size_t) lz77_decompress(pool->comp + m * pool->comp_stride,
+                                        (int) pool->comp_size[m], pool->decomp,
+                                        (int) pool->size);
+    return (size_t) lz77_compress(pool->raw + m * pool->size, (int) pool->size,
+                                  pool->comp + m * pool->comp_stride, workmem);
+}
+
+/* Back-to-back clock reads, the floor of every per-call sample */
+static uint64_t timer_overhead(void)
+{
+    uint64_t samples[1001];
+    for (int i = 0; i < 1001; i++) {
+        uint64_t t = now_ns();
+        samples[i] = now_ns() - t;
+    }
+    qsort(samples, 1001, sizeof(uint64_t), compare_u64);
+    return samples[500];
+}
+
+static int bench_messages_phase(struct message_pool *pool,
+                                bool decompress,
+                                const struct bench_options *opts,
+                                void *workmem,
+                                struct perf_group *counters,
+                                uint64_t *samples,
+                                struct message_result *res)
+{
+    int n = opts->ncalls;
+    memset(res, 0, sizeof(*res));
+
+    for (int i = 0; i < opts->warmup * MESSAGE_POOL; i++)
+        message_call(pool, i % MESSAGE_POOL, decompress, workmem);
+
+    /* batch rate without per-call clock reads */
+    perf_group_start(counters);
+    uint64_t start = now_ns();
+    for (int i = 0; i < n; i++)
+        message_call(pool, i % MESSAGE_POOL, decompress, workmem);
+    uint64_t elapsed = now_ns() - start;
+    perf_group_stop(counters, &res->counters);
+    res->per_second = elapsed ? (double) n * 1e9 / (double) elapsed : 0.0;
+
+    for (int i = 0; i < n; i++) {
+        uint64_t t = now_ns();
+        size_t size = message_call(pool, i % MESSAGE_POOL, decompress, workmem);
+        samples[i] = now_ns() - t;
+        if (decompress && size != pool->size)
+            return -1;
+    }
+
+    qsort(samples, n, sizeof(uint64_t), compare_u64);
+    res->p50 = quantile(samples, n, 500);
+    res->p99 = quantile(samples, n, 990);
+    res->p999 = quantile(samples, n, 999);
+    return 0;
+}
+
+static void print_message_phase(const struct message_result *res,
+                                bool use_counters)
+{
+    printf(" %7" PRIu64 " %7" PRIu64 " %7" PRIu64 " %9.0f", res->p50, res->p99,
+           res->p999, res->per_second);
+    if (use_counters) {
+        if (res->counters.valid[CTR_CYCLES])
+            printf(" %8.0f", res->counters.value[CTR_CYCLES]);
+        else
+            printf(" %8s", "-");
+    }
+}
+
+static int run_messages(const struct bench_options *opts,
+                        const char **names,
+                        int nfiles,
+                        bool use_default)
+{
+    uint8_t *source = malloc(MAX_SOURCE);
+    void *workmem = malloc(LZ77_WORKMEM_SIZE);
+    uint64_t *samples = calloc(opts->ncalls, sizeof(uint64_t));
+    struct perf_group counters = {.leader = -1};
+    int status = 0;
+
+    if (!source || !workmem || !samples) {
+        fprintf(stderr, "Error: cannot allocate message buffers\n");
+        status = 1;
+        goto out;
+    }
+
+    size_t source_len = load_source(opts, names, nfiles, use_default, source);
+    bool use_counters = opts->counters && perf_group_open(&counters) > 0;
+
+    printf("Latency in ns per call (timer overhead %" PRIu64
+           " ns included), rate in messages/s on one core\n",
+           timer_overhead());
+    printf("%-8s %7s %7s %7s %7s %9s", "Size", "Ratio", "C p50", "C p99",
+           "C p999", "C msg/s");
+    if (use_counters)
+        printf(" %8s", "C cyc");
+    printf(" %7s %7s %7s %9s", "D p50", "D p99", "D p999", "D msg/s");
+    if (use_counters)
+        printf(" %8s", "D cyc");
+    printf("\n");
+
+    for (int i = 0; i < opts->nsizes && !status; i++) {
+        struct message_pool pool;
+        struct message_result comp, decomp;
+
+        if (pool_init(&pool, opts->sizes[i], source, source_len, workmem) <
+            0) {
+            fprintf(stderr, "Error: cannot allocate message pool\n");
+            status = 1;
+        } else if (bench_messages_phase(&pool, false, opts, workmem,
+                                        &counters, samples, &comp) < 0 ||
+                   bench_messages_phase(&pool, true, opts, workmem, &counters,
+                                        samples, &decomp) < 0) {
+            fprintf(stderr, "Error: %zu-byte messages do not round-trip\n",
+                    pool.size);
+            status = 1;
+        } else {
+            size_t total = 0;
+            for (int m = 0; m < MESSAGE_POOL; m++)
+                total += pool.comp_size[m];
+            average_counters(&comp.counters, opts->ncalls);
+            average_counters(&decomp.counters, opts->ncalls);
+
+            printf(
+                "%-8zu %6.2f%%", pool.size,
+                100.0 * (double) total / (double) (MESSAGE_POOL * pool.size));
+            print_message_phase(&comp, use_counters);
+            print_message_phase(&decomp, use_counters);
+            printf("\n");
+        }
+        pool_free(&pool);
+    }
+
+out:
+    perf_group_close(&counters);
+    free(source);
+    free(workmem);
+    free(samples);
+    return status;
+}
+
+/* Pareto mode */
+
+/* One configuration of the sweep, summed over the files it ran on */
+struct pareto_point {
+    size_t block_size;
+    bool chained;
+    size_t size, comp_size;
+    uint64_t comp_ns, decomp_ns;
+    bool frontier;
+};
+
+/* Mark the points no other point beats on both compressed size and
+ * compression time
+ */
+static void pareto_frontier(struct pareto_point *p, int n)
+{
+    for (int i = 0; i < n; i++) {
+        p[i].frontier = true;
+        for (int j = 0; j < n && p[i].frontier; j++) {
+            if (p[j].comp_size <= p[i].comp_size &&
+                p[j].comp_ns <= p[i].comp_ns &&
+                (p[j].comp_size < p[i].comp_size ||
+                 p[j].comp_ns < p[i].comp_ns))
+                p[i].frontier = false;
+        }
+    }
+}
+
+static void pareto_csv(FILE *csv,
+                       const char *name,
+                       const struct pareto_point *p,
+                       int n)
+{
+    for (int i = 0; i < n; i++)
+        fprintf(csv, "\"%s\",%zu,%d,%zu,%zu,%.2f,%.2f,%.2f,%d\n", name,
+                p[i].block_size, p[i].chained, p[i].size, p[i].comp_size,
+                percent(p[i].comp_size, p[i].size),
+                mb_per_s(p[i].size, p[i].comp_ns),
+                mb_per_s(p[i].size, p[i].decomp_ns), p[i].frontier);
+}
+
+/* The frontier from the best ratio to the fastest compression */
+static void print_frontier(const char *name,
+                           const struct pareto_point *p,
+                           int n)
+{
+    bool shown[MAX_PARETO_POINTS] = {false};
+
+    printf("\n%s\n", name);
+    for (;;) {
+        int best = -1;
+        for (int i = 0; i < n; i++) {
+            if (p[i].frontier && !shown[i] &&
+                (best < 0 || p[i].comp_size < p[best].comp_size))
+                best = i;
+        }
+        if (best < 0)
+            break;
+        shown[best] = true;
+
+        char block[32];
+        if (p[best].block_size)
+            snprintf(block, sizeof(block), "%zu", p[best].block_size);
+        else
+            snprintf(block, sizeof(block), "file");
+        printf("  %6.2f%% %9.1f %9.1f  %-8s %s\n",
+               percent(p[best].comp_size, p[best].size),
+               mb_per_s(p[best].size, p[best].comp_ns),
+               mb_per_s(p[best].size, p[best].decomp_ns), block,
+               p[best].chained ? "chained" : "independent");
+    }
+}
+
+static int run_pareto(const struct bench_options *opts,
+                      const char **names,
+                      int nfiles,
+                      bool use_default)
+{
+    struct pareto_point total[MAX_PARETO_POINTS], point[MAX_PARETO_POINTS];
+    struct perf_group counters = {.leader = -1};
+    int npoints = 0, benched = 0, status = 0;
+
+    /* chained blocks make no difference when the file is one block */
+    for (int i = 0; i < opts->nblock_sizes; i++) {
+        total[npoints++] = (struct pareto_point){
+            .block_size = opts->block_sizes[i],
+            .chained = false,
+        };
+        if (opts->block_sizes[i])
+            total[npoints++] = (struct pareto_point){
+                .block_size = opts->block_sizes[i],
+                .chained = true,
+            };
+    }
+
+    /* room for a struct lz77_stream in chained runs */
+    void *workmem = malloc(sizeof(struct lz77_stream));
+    FILE *csv = fopen(opts->pareto, "w");
+    if (!workmem || !csv) {
+        fprintf(stderr, "Error: cannot %s\n",
+                workmem ? "create the CSV file" : "allocate workmem");
+        free(workmem);
+        if (csv)
+            fclose(csv);
+        return 1;
+    }
+    fprintf(csv, "file,block_size,chained,size,compressed,ratio_pct,"
+                 "comp_mb_s,decomp_mb_s,frontier\n");
+
+    printf("Pareto frontier of ratio against compression speed: ratio, median "
+           "MB/s\nof compression and decompression, block size, blocks\n");
+    for (int i = 0; i < nfiles && !status; i++) {
+        const char *name = names[i];
+        char path[4096];
+        if (use_default)
+            snprintf(path, sizeof(path), "%s/%s", opts->dataset, name);
+        else
+            snprintf(path, sizeof(path), "%s", name);
+
+        struct bench_file f;
+        if (load_file(&f, name, path, 0) < 0)
+            continue;
+        for (int k = 0; k < npoints; k++) {
+            struct bench_options o = *opts;
+            struct bench_result res;
+            o.chained = total[k].chained;
+            if (layout_blocks(&f, total[k].block_size) < 0) {
+                fprintf(stderr, "Error: cannot allocate buffers for %s\n",
+                        path);
+                status = 1;
+                break;
+            }
+            if (bench_file(&f, &o, workmem, &counters, &res) < 0) {
+                status = 1;
+                break;
+            }
+            point[k] = (struct pareto_point){
+                .block_size = total[k].block_size,
+                .chained = total[k].chained,
+                .size = f.size,
+                .comp_size = f.comp_size,
+                .comp_ns = res.comp_median,
+                .decomp_ns = res.decomp_median,
+            };
+            total[k].size += f.size;
+            total[k].comp_size += f.comp_size;
+            total[k].comp_ns += res.comp_median;
+            total[k].decomp_ns += res.decomp_median;
+        }
+        free_file(&f);
+        if (status)
+            break;
+
+        pareto_frontier(point, npoints);
+        pareto_csv(csv, name, point, npoints);
+        print_frontier(name, point, npoints);
+        benched++;
+    }
+
+    if (benched > 0 && !status) {
+        pareto_frontier(total, npoints);
+        pareto_csv(csv, "Total", total, npoints);
+        print_frontier("Total", total, npoints);
+        printf("\nAll %d configurations written to %s\n", npoints,
+               opts->pareto);
+    } else if (!status) {
+        fprintf(stderr, "Error: no input files%s\n",
+                use_default ? " (run scripts/download-dataset.sh)" : "");
+        status = 1;
+    }
+
+    if (fclose(csv) != 0 && !status) {
+        fprintf(stderr, "Error: cannot write %s\n", opts->pareto);
+        status = 1;
+    }
+    free(workmem);
+    return status;
+}
+
+/* Parse a comma-separated list of at most capacity sizes within [min, max] */
+static int parse_sizes(const char *arg,
+                       long min,
+                       long max,
+                       size_t *sizes,
+                       int capacity,
+                       int *nsizes)
+{
+    *nsizes = 0;
+    while (*arg) {
+        char *end;
+        long v = strtol(arg, &end, 10);
+        if (end == arg || v < min || v > max ||
+            *nsizes == capacity || (*end && *end != ',')) {
+            fprintf(stderr, "Error: invalid sizes %s\n", arg);
+            return -1;
+        }
+        sizes[(*nsizes)++] = (size_t) v;
+        arg = *end ? end + 1 : end;
+    }
+    return *nsizes ? 0 : -1;
+}
+
+static void show_usage(void)
+{
+    printf(
+        "lz77bench: measure lz77 compression and decompression throughput\n"
+        "Usage: lz77bench [options] [file...]\n"
+        "\n"
+        "Without files, runs over the test corpus in the dataset directory.\n"
+        "Speeds are MB/s at the median (med) and 99th percentile (p99) time\n"
+        "of the timed iterations.\n"
+        "\n"
+        "Options:\n"
+        "  -d DIR    dataset directory (default: tests/dataset)\n"
+        "  -b SIZE   block size in bytes, 0 for whole files "
+        "(default: %d)\n"
+        "  -i N      timed iterations per file (default: %d)\n"
+        "  -w N      warm-up iterations per file (default: %d)\n"
+        "  -c        read hardware counters (Linux perf events) during the\n"
+        "            timed iterations\n"
+        "  -J, --json\n"
+        "            print the results as JSON, one file per line\n"
+        "  -S        report hash probe outcomes, table fill and match\n"
+        "            statistics from one extra untimed pass\n"
+        "  -C, --cold\n"
+        "            also time single-block decompression after flushing the\n"
+        "            caches (%d MiB streamed, %d samples per iteration) and\n"
+        "            warm on the same block\n"
+        "  -R, --roofline\n"
+        "            compare decompression with memcpy()/memset() on the same\n"
+        "            buffers and split its time into literal copies, match\n"
+        "            copies and the token loop\n"
+        "\n"
+        "Message mode:\n"
+        "  -m        time single calls on small messages cut from the files\n"
+        "            (or from generated RPC records without any)\n"
+        "  -s LIST   message sizes (default: 64,256,1024,4096,16384)\n"
+        "  -n N      timed calls per size and phase (default: %d)\n"
+        "\n"
+        "Pareto mode:\n"
+        "  -P, --pareto FILE\n"
+        "            run every file under each block size, with independent\n"
+        "            and chained blocks, write all results to the CSV FILE\n"
+        "            and print the ratio/speed Pareto frontier\n"
+        "  -B LIST   block sizes, 0 for whole files\n"
+        "            (default: 4096,16384,65536,131072,1048576,0)\n"
+        "\n",
+        DEFAULT_BLOCK_SIZE, DEFAULT_ITERATIONS, DEFAULT_WARMUP,
+        COLD_EVICT_SIZE / (1024 * 1024), COLD_SAMPLES, DEFAULT_MESSAGES);
+}
+
+static int parse_count(const char *arg, long min, long max, long *value)
+{
+    char *end;
+    long v = strtol(arg, &end, 10);
+    if (!*arg || *end || v < min || v > max) {
+        fprintf(stderr, "Error: invalid number %s\n", arg);
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+static int run_throughput(const struct bench_options *opts,
+                          const char **names,
+                          int nfiles,
+                          bool use_default)
+{
+    void *workmem = malloc(LZ77_WORKMEM_SIZE);
+    struct bench_report *reports = calloc(nfiles, sizeof(*reports));
+    uint8_t *evict = opts->cold ? malloc(COLD_EVICT_SIZE) : NULL;
+    if (!workmem || !reports || (opts->cold && !evict)) {
+        free(workmem);
+        free(reports);
+        free(evict);
+        fprintf(stderr, "Error: cannot allocate workmem\n");
+        return 1;
+    }
+    if (evict)
+        memset(evict, 0, COLD_EVICT_SIZE); /* fault the pages in up front */
+
+    struct perf_group counters = {.leader = -1};
+    bool use_counters = opts->counters && perf_group_open(&counters) > 0;
+
+    size_t total_size = 0, total_comp = 0;
+    struct bench_result total = {0};
+    int benched = 0, status = 0;
+
+    if (!opts->json)
+        print_header();
+    for (int i = 0; i < nfiles; i++) {
+        const char *name = names[i];
+        char path[4096];
+        if (use_default)
+            snprintf(path, sizeof(path), "%s/%s", opts->dataset, name);
+        else
+            snprintf(path, sizeof(path), "%s", name);
+
+        struct bench_file f;
+        struct bench_result res;
+        if (load_file(&f, name, path, opts->block_size) < 0)
+            continue;
+        if (bench_file(&f, opts, workmem, &counters, &res) < 0) {
+            free_file(&f);
+            status = 1;
+            break;
+        }
+        if (!opts->json)
+            print_row(name, f.size, f.comp_size, &res);
+
+        /* totals weigh every file by its time, as one long run would */
+        total_size += f.size;
+        total_comp += f.comp_size;
+        total.comp_median += res.comp_median;
+        total.comp_p99 += res.comp_p99;
+        total.decomp_median += res.decomp_median;
+        total.decomp_p99 += res.decomp_p99;
+        total.comp_mad += res.comp_mad;
+        total.decomp_mad += res.decomp_mad;
+        reports[benched] = (struct bench_report){
+            .name = name,
+            .size = f.size,
+            .comp_size = f.comp_size,
+            .res = res,
+        };
+        if (opts->cold &&
+            cold_pass(&f, opts, evict, &reports[benched].cold) < 0) {
+            free_file(&f);
+            status = 1;
+            break;
+        }
+        if (opts->roofline &&
+            roofline_pass(&f, opts, &reports[benched].roofline) < 0) {
+            free_file(&f);
+            status = 1;
+            break;
+        }
+        if (opts->stats)
+            stats_pass(&f, workmem, &reports[benched].stats);
+        benched++;
+        free_file(&f);
+    }
+
+    if (benched > 0 && !status && opts->json)
+        print_json(opts, reports, benched, total_size, total_comp, &total);
+    else if (benched > 0 && !status)
+        print_row("Total", total_size, total_comp, &total);
+    else if (!status) {
+        fprintf(stderr, "Error: no input files%s\n",
+                use_default ? " (run scripts/download-dataset.sh)" : "");
+        status = 1;
+    }
+
+    if (use_counters && benched > 0 && !status)
+        print_counters(reports, benched);
+    if (opts->stats && benched > 0 && !status)
+        print_stats(reports, benched);
+    if (opts->cold && benched > 0 && !status)
+        print_cold(reports, benched);
+    if (opts->roofline && benched > 0 && !status)
+        print_roofline(reports, benched);
+
+    perf_group_close(&counters);
+    free(reports);
+    free(workmem);
+    free(evict);
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_options opts = {
+        .dataset = "tests/dataset",
+        .block_size = DEFAULT_BLOCK_SIZE,
+        .iterations = DEFAULT_ITERATIONS,
+        .warmup = DEFAULT_WARMUP,
+        .ncalls = DEFAULT_MESSAGES,
+        .sizes = {64, 256, 1024, 4096, 16384},
+        .nsizes = 5,
+        .block_sizes = DEFAULT_PARETO_SIZES,
+        .nblock_sizes = DEFAULT_PARETO_NSIZES,
+    };
+    static const struct option long_options[] = {
+        {"counters", no_argument, NULL, 'c'},
+        {"messages", no_argument, NULL, 'm'},
+        {"stats", no_argument, NULL, 'S'},
+        {"json", no_argument, NULL, 'J'},
+        {"cold", no_argument, NULL, 'C'},
+        {"roofline", no_argument, NULL, 'R'},
+        {"pareto", required_argument, NULL, 'P'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int c;
+    long value;
+    while ((c = getopt_long(argc, argv, "B:b:Ccd:hi:JmP:Rn:Ss:w:",
+                            long_options, NULL)) != -1) {
+        switch (c) {
+        case 'B':
+            if (parse_sizes(optarg, 0, MAX_FILE_SIZE, opts.block_sizes,
+                            MAX_PARETO_SIZES, &opts.nblock_sizes) < 0)
+                return 1;
+            break;
+        case 'b':
+            if (parse_count(optarg, 0, MAX_FILE_SIZE, &value) < 0)
+                return 1;
+            opts.block_size = (size_t) value;
+            break;
+        case 'C':
+            opts.cold = true;
+            break;
+        case 'c':
+            opts.counters = true;
+            break;
+        case 'd':
+            opts.dataset = optarg;
+            break;
+        case 'i':
+            if (parse_count(optarg, 1, 1000000, &value) < 0)
+                return 1;
+            opts.iterations = (int) value;
+            break;
+        case 'J':
+            opts.json = true;
+            break;
+        case 'm':
+            opts.messages = true;
+            break;
+        case 'P':
+            opts.pareto = optarg;
+            break;
+        case 'R':
+            opts.roofline = true;
+            break;
+        case 'n':
+            if (parse_count(optarg, 1, 10000000, &value) < 0)
+                return 1;
+            opts.ncalls = (int) value;
+            break;
+        case 'S':
+            opts.stats = true;
+            break;
+        case 's':
+            if (parse_sizes(optarg, 1, MAX_MESSAGE_SIZE, opts.sizes,
+                            MAX_MESSAGE_SIZES, &opts.nsizes) < 0)
+                return 1;
+            break;
+        case 'w':
+            if (parse_count(optarg, 0, 1000000, &value) < 0)
+                return 1;
+            opts.warmup = (int) value;
+            break;
+        case 'h':
+            show_usage();
+            return 0;
+        default:
+            show_usage();
+            return 1;
+        }
+    }
+
+    bool use_default = optind == argc;
+    const char **names = use_default ? default_files
+                                     : (const char **) argv + optind;
+    int nfiles = use_default ? (int) (sizeof(default_files) /
+                                      sizeof(default_files[0]))
+                             : argc - optind;
+
+    if (opts.json && (opts.messages || opts.counters || opts.stats ||
+                      opts.cold || opts.roofline)) {
+        fprintf(stderr, "Error: --json cannot be combined with -m, -c, -S, "
+                        "-C or -R\n");
+        return 1;
+    }
+    if (opts.messages && (opts.cold || opts.roofline)) {
+        fprintf(stderr, "Error: -C and -R cannot be combined with -m\n");
+        return 1;
+    }
+    if (opts.pareto && (opts.messages || opts.json || opts.counters ||
+                        opts.stats || opts.cold || opts.roofline)) {
+        fprintf(stderr, "Error: -P cannot be combined with other reports\n");
+        return 1;
+    }
+    if (opts.pareto)
+        return run_pareto(&opts, names, nfiles, use_default);
+    if (opts.messages)
+        return run_messages(&opts, names, nfiles, use_default);
+    return run_throughput(&opts, names, nfiles, use_default);
+}
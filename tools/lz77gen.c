@@ -0,0 +1,390 @@
+/* lz77gen: synthetic data with controlled statistics for benchmarks
+ *
+ * The output is built the way an LZ77 decoder rebuilds data: alternating
+ * literal runs and copies of earlier output. Each knob sets one property of
+ * that token stream, so a benchmark can sweep it while the others stay put:
+ *
+ *   literal entropy  literals are uniform over 2^bits symbols
+ *   literal density  share of the output produced by literal runs
+ *   match lengths    geometric with the given mean, at least 3 bytes
+ *   match distances  geometric with the given mean, up to a limit
+ *   repeat offsets   share of copies that reuse the previous distance
+ *   byte runs        share of copies at distance 1 (runs of one byte)
+ *   record stride    distances rounded up to whole records
+ *
+ * The same seed and options always give the same bytes: the generator is a
+ * splitmix64 sequence and every sample is drawn in a fixed order.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz77.h"
+
+#define DEFAULT_SIZE (16 * 1024 * 1024)
+#define MAX_SIZE ((uint64_t) 1 << 40)
+#define WRITE_BUFFER (1024 * 1024)
+
+struct gen_options {
+    uint64_t size;
+    uint64_t seed;
+    double entropy;      /* bits per literal, 0 to 8 */
+    double density;      /* literal share of the output, 0 to 1 */
+    double match_length; /* mean copy length */
+    double distance;     /* mean copy distance */
+    uint32_t max_distance;
+    double repeat;      /* share of copies reusing the previous distance */
+    double runs;        /* share of copies at distance 1 */
+    uint32_t stride;    /* record size, 0 for none */
+    bool verbose;
+};
+
+/* What was actually generated, printed with -v */
+struct gen_totals {
+    uint64_t literals, literal_runs;
+    uint64_t copies, copy_bytes, distance_sum;
+    uint64_t repeats, runs;
+};
+
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in (0, 1] */
+static double next_unit(uint64_t *state)
+{
+    return (double) ((next_random(state) >> 11) + 1) / 9007199254740992.0;
+}
+
+static bool next_chance(uint64_t *state, double p)
+{
+    return p > 0 && next_unit(state) <= p;
+}
+
+/* Geometric sample of at least min with the given mean */
+static uint64_t next_geometric(uint64_t *state, double mean, uint64_t min)
+{
+    if (mean <= (double) min)
+        return min;
+    double q = 1.0 - 1.0 / (mean - (double) min + 1.0);
+    return min + (uint64_t) floor(log(next_unit(state)) / log(q));
+}
+
+/* The last max_distance bytes of output, all a copy can reach, are kept in
+ * a ring; the output is written out in WRITE_BUFFER pieces
+ */
+struct gen_output {
+    FILE *file;
+    uint8_t *ring;
+    size_t ring_size, head; /* head: next position in the ring */
+    uint64_t written;       /* bytes produced */
+    uint8_t *buffer;
+    size_t used;
+};
+
+static int emit(struct gen_output *out, uint8_t c)
+{
+    out->ring[out->head] = c;
+    out->head = out->head + 1 == out->ring_size ? 0 : out->head + 1;
+    out->written++;
+    out->buffer[out->used++] = c;
+    if (out->used == WRITE_BUFFER) {
+        if (fwrite(out->buffer, 1, out->used, out->file) != out->used)
+            return -1;
+        out->used = 0;
+    }
+    return 0;
+}
+
+static uint8_t back(const struct gen_output *out, uint64_t distance)
+{
+    size_t pos = out->head >= distance
+                     ? out->head - distance
+                     : out->head + out->ring_size - distance;
+    return out->ring[pos];
+}
+
+static int generate(const struct gen_options *opts,
+                    FILE *file,
+                    struct gen_totals *totals)
+{
+    uint64_t state = opts->seed;
+    memset(totals, 0, sizeof(*totals));
+
+    /* literal alphabet: the first 2^bits bytes of a seeded permutation */
+    uint8_t alphabet[256];
+    for (int i = 0; i < 256; i++)
+        alphabet[i] = (uint8_t) i;
+    for (int i = 255; i > 0; i--) {
+        int j = (int) (next_random(&state) % (uint64_t) (i + 1));
+        uint8_t t = alphabet[i];
+        alphabet[i] = alphabet[j];
+        alphabet[j] = t;
+    }
+    uint32_t symbols = (uint32_t) lround(pow(2.0, opts->entropy));
+    if (symbols < 1)
+        symbols = 1;
+
+    /* mean literal run for the requested literal share of the output */
+    double literal_run =
+        opts->density >= 1.0
+            ? (double) opts->size
+            : opts->density / (1.0 - opts->density) * opts->match_length;
+
+    struct gen_output out = {.file = file};
+    out.ring_size = (size_t) opts->max_distance + 1;
+    out.ring = calloc(out.ring_size, 1);
+    out.buffer = malloc(WRITE_BUFFER);
+    if (!out.ring || !out.buffer) {
+        free(out.ring);
+        free(out.buffer);
+        fprintf(stderr, "Error: cannot allocate buffers\n");
+        return -1;
+    }
+
+    uint64_t last_distance = 1;
+    int status = 0;
+    while (out.written < opts->size && status == 0) {
+        uint64_t left = opts->size - out.written;
+
+        /* literal run; the first one also gives copies something to copy */
+        uint64_t n = next_geometric(&state, literal_run, out.written ? 0 : 1);
+        n = n < left ? n : left;
+        if (n) {
+            totals->literal_runs++;
+            totals->literals += n;
+        }
+        for (uint64_t i = 0; i < n && status == 0; i++)
+            status = emit(&out, alphabet[next_random(&state) % symbols]);
+        left -= n;
+        if (!left || status)
+            break;
+
+        /* copy: a byte run, the previous distance or a fresh one */
+        uint64_t length = next_geometric(&state, opts->match_length,
+                                         MIN_MATCH_LEN);
+        uint64_t distance;
+        if (next_chance(&state, opts->runs)) {
+            distance = 1;
+            totals->runs++;
+        } else if (next_chance(&state, opts->repeat)) {
+            distance = last_distance;
+            totals->repeats++;
+        } else {
+            distance = next_geometric(&state, opts->distance, 1);
+            if (opts->stride)
+                distance = (distance + opts->stride - 1) / opts->stride *
+                           opts->stride;
+            if (distance > opts->max_distance)
+                distance = opts->max_distance;
+        }
+        if (distance > out.written)
+            distance = out.written;
+        last_distance = distance;
+
+        length = length < left ? length : left;
+        totals->copies++;
+        totals->copy_bytes += length;
+        totals->distance_sum += distance;
+        for (uint64_t i = 0; i < length && status == 0; i++)
+            status = emit(&out, back(&out, distance));
+    }
+
+    if (status == 0 && out.used &&
+        fwrite(out.buffer, 1, out.used, out.file) != out.used)
+        status = -1;
+    if (status < 0)
+        fprintf(stderr, "Error: cannot write output: %s\n", strerror(errno));
+    free(out.ring);
+    free(out.buffer);
+    return status;
+}
+
+static void show_usage(void)
+{
+    printf(
+        "lz77gen: generate data with controlled compression statistics\n"
+        "Usage: lz77gen [options] [output-file]\n"
+        "\n"
+        "Writes to standard output without an output file. The same seed and\n"
+        "options always produce the same data.\n"
+        "\n"
+        "Options:\n"
+        "  -n SIZE   bytes to generate, K/M/G suffixes allowed (default: 16M)\n"
+        "  -s SEED   random seed (default: 1)\n"
+        "  -e BITS   literal entropy in bits per byte, 0-8 (default: 8)\n"
+        "  -p PCT    share of output bytes that are literals (default: 30)\n"
+        "  -l MEAN   mean match length, at least 3 (default: 8)\n"
+        "  -d MEAN   mean match distance (default: 1024)\n"
+        "  -D MAX    largest match distance (default: %d)\n"
+        "  -r PCT    share of matches repeating the previous distance\n"
+        "            (default: 0)\n"
+        "  -R PCT    share of matches at distance 1, i.e. byte runs\n"
+        "            (default: 0)\n"
+        "  -t BYTES  record stride: distances are whole records (default: 0)\n"
+        "  -v        print the generated statistics to standard error\n"
+        "\n",
+        MAX_DISTANCE);
+}
+
+static int parse_number(const char *arg, double min, double max, double *value)
+{
+    char *end;
+    errno = 0;
+    double v = strtod(arg, &end);
+    if (!*arg || *end || errno || !(v >= min && v <= max)) {
+        fprintf(stderr, "Error: invalid value %s\n", arg);
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+/* Byte count with an optional K, M or G (binary) suffix */
+static int parse_size(const char *arg, uint64_t *value)
+{
+    char *end;
+    errno = 0;
+    double v = strtod(arg, &end);
+    const char *suffixes = "KMG";
+    const char *s = *end ? strchr(suffixes, *end) : NULL;
+    if (s && !end[1])
+        v *= (double) (1u << (10 * (s - suffixes + 1)));
+    if (!*arg || (*end && (!s || end[1])) || errno ||
+        !(v >= 0 && v <= (double) MAX_SIZE)) {
+        fprintf(stderr, "Error: invalid size %s\n", arg);
+        return -1;
+    }
+    *value = (uint64_t) v;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct gen_options opts = {
+        .size = DEFAULT_SIZE,
+        .seed = 1,
+        .entropy = 8.0,
+        .density = 0.3,
+        .match_length = 8.0,
+        .distance = 1024.0,
+        .max_distance = MAX_DISTANCE,
+    };
+    static const struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int c;
+    double value;
+    while ((c = getopt_long(argc, argv, "D:d:e:hl:n:p:R:r:s:t:v", long_options,
+                            NULL)) != -1) {
+        switch (c) {
+        case 'D':
+            if (parse_number(optarg, 1, 1u << 30, &value) < 0)
+                return 1;
+            opts.max_distance = (uint32_t) value;
+            break;
+        case 'd':
+            if (parse_number(optarg, 1, 1u << 30, &opts.distance) < 0)
+                return 1;
+            break;
+        case 'e':
+            if (parse_number(optarg, 0, 8, &opts.entropy) < 0)
+                return 1;
+            break;
+        case 'l':
+            if (parse_number(optarg, MIN_MATCH_LEN, 1u << 20,
+                             &opts.match_length) < 0)
+                return 1;
+            break;
+        case 'n':
+            if (parse_size(optarg, &opts.size) < 0)
+                return 1;
+            break;
+        case 'p':
+            if (parse_number(optarg, 0, 100, &value) < 0)
+                return 1;
+            opts.density = value / 100.0;
+            break;
+        case 'R':
+            if (parse_number(optarg, 0, 100, &value) < 0)
+                return 1;
+            opts.runs = value / 100.0;
+            break;
+        case 'r':
+            if (parse_number(optarg, 0, 100, &value) < 0)
+                return 1;
+            opts.repeat = value / 100.0;
+            break;
+        case 's': {
+            char *end;
+            errno = 0;
+            opts.seed = strtoull(optarg, &end, 0);
+            if (!*optarg || *end || errno || *optarg == '-') {
+                fprintf(stderr, "Error: invalid seed %s\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 't':
+            if (parse_number(optarg, 0, 1u << 20, &value) < 0)
+                return 1;
+            opts.stride = (uint32_t) value;
+            break;
+        case 'v':
+            opts.verbose = true;
+            break;
+        case 'h':
+            show_usage();
+            return 0;
+        default:
+            show_usage();
+            return 1;
+        }
+    }
+    if (argc - optind > 1) {
+        show_usage();
+        return 1;
+    }
+
+    FILE *file = stdout;
+    if (optind < argc && !(file = fopen(argv[optind], "wb"))) {
+        fprintf(stderr, "Error: cannot create %s\n", argv[optind]);
+        return 1;
+    }
+
+    struct gen_totals t;
+    int status = generate(&opts, file, &t);
+    if (file != stdout ? fclose(file) != 0 : fflush(file) != 0)
+        status = -1;
+    if (status < 0)
+        return 1;
+
+    if (opts.verbose) {
+        fprintf(stderr,
+                "%" PRIu64 " bytes: %.1f%% literals in %" PRIu64
+                " runs, %" PRIu64 " matches (mean length %.1f, mean distance "
+                "%.1f, %.1f%% repeats, %.1f%% byte runs)\n",
+                opts.size,
+                opts.size ? 100.0 * (double) t.literals / (double) opts.size
+                          : 0.0,
+                t.literal_runs, t.copies,
+                t.copies ? (double) t.copy_bytes / (double) t.copies : 0.0,
+                t.copies ? (double) t.distance_sum / (double) t.copies : 0.0,
+                t.copies ? 100.0 * (double) t.repeats / (double) t.copies
+                         : 0.0,
+                t.copies ? 100.0 * (double) t.runs / (double) t.copies : 0.0);
+    }
+    return 0;
+}
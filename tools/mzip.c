@@ -1,9 +1,23 @@
+/* SEEK_DATA/SEEK_HOLE, fallocate() and copy_file_range() are GNU extensions
+ * on glibc
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "lz77.h"
 
@@ -25,9 +39,31 @@
 #define MZIP_MAGIC_SIZE 8
 #define MZIP_CHUNK_HEADER_SIZE 16
 #define MZIP_FILEINFO_CHUNK_ID 1
+#define MZIP_DIRECTORY_CHUNK_ID 2
+#define MZIP_TRAILER_CHUNK_ID 3
 #define MZIP_DATA_CHUNK_ID 17
+#define MZIP_HOLE_CHUNK_ID 18 /* payload: hole length:8 */
+#define MZIP_HOLE_PAYLOAD_SIZE 8
 #define MZIP_FILEINFO_FIXED_SIZE 10
 
+/* Appended segment: a file info chunk whose data continues a member of the
+ * same name at the given offset. Its payload ends with [base offset:8] after
+ * the name, and its directory entry carries MZIP_MEMBER_SEGMENT.
+ */
+#define MZIP_FILEINFO_SEGMENT 1
+#define MZIP_MEMBER_SEGMENT 1
+
+/* Central directory: one entry per member, written after the last member and
+ * located through a fixed-size trailer chunk at the very end of the archive.
+ * Entry layout: [fileinfo offset:8][size:8][chunks:4][flags:2][name length:2]
+ * followed by the NUL-terminated name. Readers that predate the directory skip
+ * both chunks as unknown chunk types.
+ */
+#define MZIP_DIRENT_FIXED_SIZE 24
+#define MZIP_TRAILER_PAYLOAD_SIZE 8
+#define MZIP_TRAILER_SIZE (MZIP_CHUNK_HEADER_SIZE + MZIP_TRAILER_PAYLOAD_SIZE)
+#define MAX_DIRECTORY_SIZE (64 * 1024 * 1024) /* 64 MiB */
+
 /* magic identifier for mzip file */
 static const uint8_t mzip_magic[MZIP_MAGIC_SIZE] = {
     '$', 'm', 'z', 'i', 'p', '$', '$', '$',
@@ -114,18 +150,42 @@ static inline uint16_t read_u16(const uint8_t *p)
 
 static inline uint32_t read_u32(const uint8_t *p)
 {
-    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t read_u64(const uint8_t *p)
+{
+    return read_u32(p) | ((uint64_t) read_u32(p + 4) << 32);
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 255;
+    p[1] = v >> 8;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, v & 0xffff);
+    put_u16(p + 2, v >> 16);
+}
+
+static inline void put_u64(uint8_t *p, uint64_t v)
+{
+    put_u32(p, v & 0xffffffff);
+    put_u32(p + 4, v >> 32);
 }
 
 /**
  * Validate filename for security against path traversal attacks.
  *
- * Rejects filenames containing:
+ * Member names are relative paths using '/' as separator, so that directory
+ * trees can be archived. Rejects filenames containing:
  * - Directory traversal sequences (..)
  * - Absolute paths (/ or \)
- * - Path separators (enforce basename only)
+ * - Backslashes, empty components (//), "." components or a trailing /
  * - Control characters (ASCII < 32 or DEL)
- * - Empty or excessively long names (>255 chars)
+ * - Empty or excessively long names (>4095 chars, >255 per component)
  *
  * @param filename Path to validate
  * @return true if safe for use, false if potentially malicious
@@ -137,7 +197,7 @@ static bool is_safe_filename(const char *filename)
 
     /* Reject empty or too-long filenames */
     size_t len = strlen(filename);
-    if (len == 0 || len > 255)
+    if (len == 0 || len > 4095)
         return false;
 
     /* Reject absolute paths */
@@ -145,6 +205,7 @@ static bool is_safe_filename(const char *filename)
         return false;
 
     /* Check each character for safety */
+    size_t component_len = 0;
     for (const char *p = filename; *p; p++) {
         /* Reject control characters */
         if ((unsigned char) *p < 32 || *p == 127)
@@ -154,13 +215,26 @@ static bool is_safe_filename(const char *filename)
         if (*p == '.' && *(p + 1) == '.')
             return false;
 
-        /* Reject path separators (enforce basename only) */
-        if (*p == '/' || *p == '\\')
+        /* Reject backslashes, which are separators on some systems */
+        if (*p == '\\')
+            return false;
+
+        if (*p != '/') {
+            if (++component_len > 255)
+                return false;
+            continue;
+        }
+
+        /* Reject empty and "." components and a trailing separator */
+        if (component_len == 0 || *(p + 1) == '\0' ||
+            (component_len == 1 && *(p - 1) == '.'))
             return false;
+        component_len = 0;
     }
 
     /* Reject special directory names */
-    if (!strcmp(filename, ".") || !strcmp(filename, ".."))
+    if (!strcmp(filename, ".") || !strcmp(filename, "..") ||
+        (component_len == 1 && filename[len - 1] == '.'))
         return false;
 
     return true;
@@ -186,431 +260,3156 @@ static bool read_chunk_header(FILE *file,
     return true;
 }
 
-int pack_file_compressed(const char *ifile, FILE *ofile)
+/* Archive member as recorded in the central directory */
+struct mzip_member {
+    char *name;
+    uint64_t offset; /* archive offset of the FILEINFO chunk */
+    uint64_t size;   /* original file size, or bytes in this segment */
+    uint32_t chunks; /* number of data and hole chunks */
+    uint16_t flags;
+    uint64_t base;  /* output offset of a segment's first byte */
+    uint64_t total; /* size including later segments (first entry only) */
+};
+
+struct mzip_directory {
+    struct mzip_member *members;
+    size_t count, capacity;
+    size_t *index; /* open-addressing name index, member index + 1 */
+    size_t index_size;
+};
+
+/* FNV-1a hash of a member name */
+static size_t name_hash(const char *name)
 {
-    FILE *in = fopen(ifile, "rb");
-    if (!in) {
-        printf("Error: could not open %s\n", ifile);
-        return -1;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const uint8_t *p = (const uint8_t *) name; *p; p++)
+        h = (h ^ *p) * 0x100000001b3ULL;
+    return (size_t) h;
+}
+
+static void directory_index_insert(struct mzip_directory *dir, size_t i)
+{
+    size_t mask = dir->index_size - 1;
+    size_t slot = name_hash(dir->members[i].name) & mask;
+    while (dir->index[slot])
+        slot = (slot + 1) & mask;
+    dir->index[slot] = i + 1;
+}
+
+static struct mzip_member *directory_add(struct mzip_directory *dir,
+                                         const char *name)
+{
+    if (dir->count == dir->capacity) {
+        size_t capacity = dir->capacity ? dir->capacity * 2 : 16;
+        struct mzip_member *tmp =
+            realloc(dir->members, capacity * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        dir->members = tmp;
+        dir->capacity = capacity;
     }
 
-    /* Use fseeko/ftello for 64-bit file size support */
-    if (fseeko(in, 0, SEEK_END) != 0) {
-        fprintf(stderr, "Error: could not seek to end of %s\n", ifile);
-        fclose(in);
-        return -1;
+    /* keep the name index at most half full */
+    if ((dir->count + 1) * 2 > dir->index_size) {
+        size_t index_size = dir->index_size ? dir->index_size * 2 : 64;
+        size_t *index = calloc(index_size, sizeof(*index));
+        if (!index)
+            return NULL;
+        free(dir->index);
+        dir->index = index;
+        dir->index_size = index_size;
+        for (size_t i = 0; i < dir->count; i++)
+            directory_index_insert(dir, i);
     }
-    off_t sz = ftello(in);
-    if (sz < 0) {
-        fprintf(stderr, "Error: could not determine size of %s\n", ifile);
-        fclose(in);
+
+    char *copy = strdup(name);
+    if (!copy)
+        return NULL;
+
+    struct mzip_member *member = &dir->members[dir->count];
+    memset(member, 0, sizeof(*member));
+    member->name = copy;
+    directory_index_insert(dir, dir->count++);
+    return member;
+}
+
+/* Return the first member (in archive order) with the given name */
+static struct mzip_member *directory_find(const struct mzip_directory *dir,
+                                          const char *name)
+{
+    if (!dir->index_size)
+        return NULL;
+
+    /* entries are never removed, so probing meets them in insertion order */
+    size_t mask = dir->index_size - 1;
+    for (size_t slot = name_hash(name) & mask; dir->index[slot];
+         slot = (slot + 1) & mask) {
+        struct mzip_member *member = &dir->members[dir->index[slot] - 1];
+        if (!strcmp(member->name, name))
+            return member;
+    }
+    return NULL;
+}
+
+/* Return the member following prev in archive order with the same name */
+static struct mzip_member *directory_find_next(const struct mzip_directory *dir,
+                                               const struct mzip_member *prev)
+{
+    size_t mask = dir->index_size - 1;
+    for (size_t slot = name_hash(prev->name) & mask; dir->index[slot];
+         slot = (slot + 1) & mask) {
+        struct mzip_member *member = &dir->members[dir->index[slot] - 1];
+        if (member > prev && !strcmp(member->name, prev->name))
+            return member;
+    }
+    return NULL;
+}
+
+static void directory_free(struct mzip_directory *dir)
+{
+    for (size_t i = 0; i < dir->count; i++)
+        free(dir->members[i].name);
+    free(dir->members);
+    free(dir->index);
+    memset(dir, 0, sizeof(*dir));
+}
+
+/* Append the directory chunk and the trailer pointing at it */
+static int write_directory(FILE *file, const struct mzip_directory *dir)
+{
+    size_t payload_size = 0;
+    for (size_t i = 0; i < dir->count; i++)
+        payload_size +=
+            MZIP_DIRENT_FIXED_SIZE + strlen(dir->members[i].name) + 1;
+    if (payload_size > MAX_DIRECTORY_SIZE) {
+        fprintf(stderr, "Error: central directory exceeds %u bytes\n",
+                MAX_DIRECTORY_SIZE);
         return -1;
     }
-    uint64_t file_size = (uint64_t) sz;
-    if (fseeko(in, 0, SEEK_SET) != 0) {
-        fprintf(stderr, "Error: could not seek to start of %s\n", ifile);
-        fclose(in);
+
+    uint8_t *payload = malloc(payload_size ? payload_size : 1);
+    if (!payload) {
+        fprintf(stderr, "Error: cannot allocate central directory\n");
         return -1;
     }
 
-    if (detect_magic(in)) {
-        printf("Error: file %s is already a mzip archive!\n", ifile);
-        fclose(in);
+    uint8_t *p = payload;
+    for (size_t i = 0; i < dir->count; i++) {
+        const struct mzip_member *member = &dir->members[i];
+        size_t name_len = strlen(member->name) + 1;
+        put_u64(p, member->offset);
+        put_u64(p + 8, member->size);
+        put_u32(p + 16, member->chunks);
+        put_u16(p + 20, member->flags);
+        put_u16(p + 22, name_len);
+        memcpy(p + MZIP_DIRENT_FIXED_SIZE, member->name, name_len);
+        p += MZIP_DIRENT_FIXED_SIZE + name_len;
+    }
+
+    off_t dir_offset = ftello(file);
+    if (dir_offset < 0) {
+        free(payload);
+        fprintf(stderr, "Error: cannot determine central directory offset\n");
         return -1;
     }
 
-    /* truncate directory prefix, e.g. "/path/to/FILE.txt" becomes "FILE.txt" */
-    const char *slash = strrchr(ifile, '/');
-    const char *shown_name = slash ? slash + 1 : ifile;
+    write_chunk_header(file, MZIP_DIRECTORY_CHUNK_ID, 0, payload_size,
+                       update_adler32(1L, payload, payload_size), dir->count);
+    fwrite(payload, 1, payload_size, file);
+    free(payload);
 
-    uint8_t buffer[BLOCK_SIZE] = {
-        [0] = file_size & 255,
-        [1] = (file_size >> 8) & 255,
-        [2] = (file_size >> 16) & 255,
-        [3] = (file_size >> 24) & 255,
-        [4] = (file_size >> 32) & 255,
-        [5] = (file_size >> 40) & 255,
-        [6] = (file_size >> 48) & 255,
-        [7] = (file_size >> 56) & 255,
-        [8] = (strlen(shown_name) + 1) & 255,
-        [9] = (strlen(shown_name) + 1) >> 8,
-    };
-    uint8_t result[BLOCK_SIZE * 2];
-    uint8_t workmem[LZ77_WORKMEM_SIZE];
+    uint8_t trailer[MZIP_TRAILER_PAYLOAD_SIZE];
+    put_u64(trailer, dir_offset);
+    write_chunk_header(file, MZIP_TRAILER_CHUNK_ID, 0, sizeof(trailer),
+                       update_adler32(1L, trailer, sizeof(trailer)), 0);
+    fwrite(trailer, 1, sizeof(trailer), file);
 
-    uint32_t checksum = update_adler32(1L, buffer, 10);
-    checksum = update_adler32(checksum, shown_name, strlen(shown_name) + 1);
-    write_chunk_header(ofile, 1, 0, 10 + strlen(shown_name) + 1, checksum, 0);
-    fwrite(buffer, 10, 1, ofile);
-    fwrite(shown_name, strlen(shown_name) + 1, 1, ofile);
+    return ferror(file) ? -1 : 0;
+}
 
-    uint64_t total_read = 0;
-    while (1) {
-        size_t bytes_read = fread(buffer, 1, BLOCK_SIZE, in);
-        total_read += bytes_read;
+/* Parse a directory chunk payload; returns false on malformed entries */
+static bool parse_directory(const uint8_t *payload,
+                            uint32_t size,
+                            uint32_t count,
+                            uint64_t fsize,
+                            struct mzip_directory *dir)
+{
+    const uint8_t *p = payload, *end = payload + size;
 
-        if (bytes_read == 0)
-            break;
+    for (uint32_t i = 0; i < count; i++) {
+        if (end - p < MZIP_DIRENT_FIXED_SIZE)
+            return false;
 
-        int chunk_size = lz77_compress(buffer, bytes_read, result, workmem);
-        if (chunk_size <= 0 || chunk_size > (int) sizeof(result)) {
+        size_t name_len = read_u16(p + 22);
+        if (name_len < 2 || (size_t) (end - p) - MZIP_DIRENT_FIXED_SIZE <
+                                name_len)
+            return false;
+
+        const char *name = (const char *) p + MZIP_DIRENT_FIXED_SIZE;
+        if (name[name_len - 1] != '\0' || strlen(name) != name_len - 1)
+            return false;
+        if (!is_safe_filename(name)) {
             fprintf(stderr,
-                    "Error: compression failed or returned invalid size %d\n",
-                    chunk_size);
-            fclose(in);
-            return -1;
+                    "Error: unsafe filename '%s' rejected (potential path "
+                    "traversal attack)\n",
+                    name);
+            return false;
         }
-        checksum = update_adler32(1L, result, chunk_size);
-        write_chunk_header(ofile, 17, 1, chunk_size, checksum, bytes_read);
-        fwrite(result, 1, chunk_size, ofile);
-    }
-    fclose(in);
 
-    if (total_read != file_size) {
-        fprintf(stderr,
-                "Error: reading %s failed (read %llu bytes, expected %llu)!\n",
-                ifile, (unsigned long long) total_read,
-                (unsigned long long) file_size);
-        return -1;
+        uint64_t offset = read_u64(p);
+        if (offset < MZIP_MAGIC_SIZE || offset >= fsize)
+            return false;
+
+        struct mzip_member *member = directory_add(dir, name);
+        if (!member)
+            return false;
+        member->offset = offset;
+        member->size = read_u64(p + 8);
+        member->chunks = read_u32(p + 16);
+        member->flags = read_u16(p + 20);
+
+        p += MZIP_DIRENT_FIXED_SIZE + name_len;
     }
 
-    return 0;
+    return p == end;
 }
 
-static int pack_file(const char *ifile, const char *ofile)
+/* Locate the central directory through the trailer chunk, whose offset is
+ * stored in *dir_offset. Returns 1 when loaded, 0 when the archive has no
+ * (valid) trailer, -1 on a damaged directory.
+ */
+static int load_directory(FILE *in,
+                          uint64_t fsize,
+                          struct mzip_directory *dir,
+                          uint64_t *dir_offset)
 {
-    /* Guard against NULL inputs */
-    if (!ifile || !ofile) {
-        fprintf(stderr, "Error: NULL file path provided\n");
-        return -1;
-    }
+    uint16_t id, options;
+    uint32_t size, checksum, extra;
+    uint8_t trailer[MZIP_TRAILER_PAYLOAD_SIZE];
 
-    FILE *file = fopen(ofile, "rb");
-    if (file) {
-        printf("Error: file %s already exists. Aborted.\n\n", ofile);
-        fclose(file);
+    if (fsize < MZIP_MAGIC_SIZE + MZIP_TRAILER_SIZE)
+        return 0;
+    if (fseeko(in, fsize - MZIP_TRAILER_SIZE, SEEK_SET) != 0 ||
+        !read_chunk_header(in, &id, &options, &size, &checksum, &extra))
+        return 0;
+    if (id != MZIP_TRAILER_CHUNK_ID || size != MZIP_TRAILER_PAYLOAD_SIZE ||
+        fread(trailer, 1, sizeof(trailer), in) != sizeof(trailer) ||
+        update_adler32(1L, trailer, sizeof(trailer)) != checksum)
+        return 0;
+
+    *dir_offset = read_u64(trailer);
+    if (*dir_offset < MZIP_MAGIC_SIZE ||
+        *dir_offset + MZIP_CHUNK_HEADER_SIZE > fsize - MZIP_TRAILER_SIZE ||
+        fseeko(in, *dir_offset, SEEK_SET) != 0 ||
+        !read_chunk_header(in, &id, &options, &size, &checksum, &extra) ||
+        id != MZIP_DIRECTORY_CHUNK_ID || size > MAX_DIRECTORY_SIZE ||
+        size > fsize - MZIP_TRAILER_SIZE - *dir_offset -
+                   MZIP_CHUNK_HEADER_SIZE) {
+        fprintf(stderr, "Error: damaged central directory\n");
         return -1;
     }
 
-    file = fopen(ofile, "wb");
-    if (!file) {
-        printf("Error: could not create %s. Aborted.\n\n", ofile);
+    uint8_t *payload = malloc(size ? size : 1);
+    if (!payload) {
+        fprintf(stderr, "Error: cannot allocate central directory\n");
         return -1;
     }
 
-    write_magic(file);
-    int ret = pack_file_compressed(ifile, file);
-    fclose(file);
+    int ret = 1;
+    if (fread(payload, 1, size, in) != size ||
+        update_adler32(1L, payload, size) != checksum ||
+        !parse_directory(payload, size, extra, fsize, dir)) {
+        fprintf(stderr, "Error: damaged central directory\n");
+        directory_free(dir);
+        ret = -1;
+    }
 
+    free(payload);
     return ret;
 }
 
-static void show_usage(bool is_compress)
+/* Rebuild the member list by walking chunk headers, for archives written
+ * without a central directory.
+ */
+static int scan_members(FILE *in, uint64_t fsize, struct mzip_directory *dir)
 {
-    if (is_compress) {
-        printf(
-            "mzip: small file compression tool\n"
-            "Usage: mzip [options] input-file output-file\n"
-            "\n");
-    } else {
-        printf(
-            "munzip: uncompress mzip archive\n"
-            "Usage: munzip archive-file\n"
-            "\n");
-    }
-}
+    uint8_t buffer[BLOCK_SIZE];
+    struct mzip_member *member = NULL;
+    uint64_t pos = MZIP_MAGIC_SIZE;
+
+    while (pos < fsize) {
+        uint16_t id, options;
+        uint32_t size, checksum, extra;
+        if (fseeko(in, pos, SEEK_SET) != 0 ||
+            !read_chunk_header(in, &id, &options, &size, &checksum, &extra)) {
+            fprintf(stderr, "Error: failed to read chunk header\n");
+            return -1;
+        }
 
-static int handle_common_args(int argc, char **argv, bool is_compress)
-{
-    if (argc == 1) {
-        show_usage(is_compress);
-        return 0;
-    }
+        if ((id == MZIP_FILEINFO_CHUNK_ID) && (size > 10) &&
+            (size < BLOCK_SIZE)) {
+            if (fread(buffer, 1, size, in) != size) {
+                fprintf(stderr, "Error: failed to read file info chunk\n");
+                return -1;
+            }
 
-    for (int i = 1; i < argc; i++) {
-        char *arg = argv[i];
-        if (!arg || arg[0] != '-')
-            continue;
+            size_t fname_len = read_u16(buffer + 8);
+            if (fname_len > size - MZIP_FILEINFO_FIXED_SIZE)
+                fname_len = size - MZIP_FILEINFO_FIXED_SIZE;
+            char *name = (char *) buffer + MZIP_FILEINFO_FIXED_SIZE;
+            name[fname_len] = '\0';
+            if (!is_safe_filename(name)) {
+                fprintf(stderr,
+                        "Error: unsafe filename '%s' rejected (potential path "
+                        "traversal attack)\n",
+                        name);
+                return -1;
+            }
 
-        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
-            show_usage(is_compress);
-            return 0;
+            member = directory_add(dir, name);
+            if (!member) {
+                fprintf(stderr, "Error: cannot allocate member list\n");
+                return -1;
+            }
+            member->offset = pos;
+            member->size = read_u64(buffer);
+            if (options & MZIP_FILEINFO_SEGMENT)
+                member->flags |= MZIP_MEMBER_SEGMENT;
+        } else if ((id == MZIP_DATA_CHUNK_ID || id == MZIP_HOLE_CHUNK_ID) &&
+                   member) {
+            member->chunks++;
         }
 
-        printf(
-            "Error: unknown option %s\n\n"
-            "To get help on usage:\n"
-            "  %s --help\n\n",
-            arg, is_compress ? "mzip" : "munzip");
-        return -1;
+        pos += MZIP_CHUNK_HEADER_SIZE + (uint64_t) size;
     }
 
-    return 1; /* Continue processing */
+    return 0;
 }
 
-static int compress(int argc, char **argv)
+/* Assign each appended segment the output offset following the earlier
+ * entries of the same name. Every name must start with a plain member.
+ */
+static bool link_segments(struct mzip_directory *dir)
 {
-    char *ifile = NULL, *ofile = NULL;
-
-    /* Handle common arguments (-h, --help, -v, --version, unknown options) */
-    int result = handle_common_args(argc, argv, true);
-    if (result <= 0)
-        return result; /* 0 = help/version shown, -1 = error */
-
-    /* Parse input and output file arguments */
-    for (int i = 1; i < argc; i++) {
-        char *argument = argv[i];
-
-        if (!argument || argument[0] == '-')
-            continue;
-
-        /* first specified file is input */
-        if (!ifile) {
-            ifile = argument;
-            continue;
-        }
-
-        /* next specified file is output */
-        if (!ofile) {
-            ofile = argument;
-            continue;
+    for (size_t i = 0; i < dir->count; i++) {
+        struct mzip_member *member = &dir->members[i];
+        struct mzip_member *first = directory_find(dir, member->name);
+        bool segment = member->flags & MZIP_MEMBER_SEGMENT;
+
+        if (first == member) {
+            if (segment)
+                return false;
+            member->base = 0;
+            member->total = member->size;
+        } else {
+            if (!segment || first->total > UINT64_MAX - member->size)
+                return false;
+            member->base = first->total;
+            first->total += member->size;
         }
     }
+    return true;
+}
 
-    /* Validate that both input and output files were provided */
-    if (!ifile || !ofile) {
-        fprintf(stderr, "Error: missing input or output file\n\n");
-        show_usage(true);
-        return -1;
+/* Load the member list of an open archive, from the central directory or by
+ * scanning chunk headers. *end receives the offset where members end, i.e.
+ * where appended members go.
+ */
+static int read_members(FILE *in,
+                        uint64_t fsize,
+                        struct mzip_directory *dir,
+                        uint64_t *end)
+{
+    int loaded = load_directory(in, fsize, dir, end);
+    if (loaded == 0) {
+        *end = fsize;
+        loaded = scan_members(in, fsize, dir) == 0 ? 1 : -1;
     }
-
-    return pack_file(ifile, ofile);
+    if (loaded > 0 && !link_segments(dir)) {
+        fprintf(stderr, "Error: duplicate or orphaned member names\n");
+        loaded = -1;
+    }
+    if (loaded < 0)
+        directory_free(dir);
+    return loaded < 0 ? -1 : 0;
 }
 
-static int unpack_file(const char *ifile)
+/* Open an archive and load its member list, either from the central
+ * directory or, for archives without one, by scanning chunk headers. When
+ * end is not NULL, it receives the offset where the member chunks end.
+ */
+static FILE *open_archive(const char *ifile,
+                          uint64_t *fsize,
+                          struct mzip_directory *dir,
+                          uint64_t *end)
 {
     /* sanity check */
     FILE *in = fopen(ifile, "rb");
     if (!in) {
         printf("Error: could not open %s\n", ifile);
-        return -1;
+        return NULL;
     }
 
-    /* find size of the file */
-    fseek(in, 0, SEEK_END);
-    long fsize = ftell(in);
-    fseek(in, 0, SEEK_SET);
-
-    /* Initialize variables before early-exit checks */
-    FILE *out = NULL;
-    uint8_t *compressed_buffer = NULL, *decompressed_buffer = NULL;
-    char *ofile_name = NULL;
-    int status = -1;
-
     /* not a mzip archive */
     if (!detect_magic(in)) {
-        fclose(in);
-        in = NULL;
         fprintf(stderr, "Error: file %s is not a mzip archive!\n", ifile);
-        goto cleanup;
+        fclose(in);
+        return NULL;
     }
 
-    /* position of first chunk */
-    fseek(in, 8, SEEK_SET);
-
-    uint8_t buffer[BLOCK_SIZE];
-    uint32_t decompressed_size = 0;
-    size_t total_extracted __attribute__((unused)) = 0;
-    size_t compressed_bufsize = 0, decompressed_bufsize = 0;
+    /* find size of the file */
+    off_t sz;
+    if (fseeko(in, 0, SEEK_END) != 0 || (sz = ftello(in)) < 0) {
+        fprintf(stderr, "Error: could not determine size of %s\n", ifile);
+        fclose(in);
+        return NULL;
+    }
+    *fsize = (uint64_t) sz;
 
-    while (1) {
-        long pos = ftell(in);
-        if (pos >= fsize)
-            break;
+    uint64_t members_end;
+    if (read_members(in, *fsize, dir, end ? end : &members_end) < 0) {
+        fclose(in);
+        return NULL;
+    }
 
-        uint16_t chunk_id, chunk_options;
-        uint32_t chunk_size, chunk_checksum, chunk_extra;
-        if (!read_chunk_header(in, &chunk_id, &chunk_options, &chunk_size,
-                               &chunk_checksum, &chunk_extra)) {
-            fprintf(stderr, "Error: failed to read chunk header\n");
-            goto cleanup;
-        }
+    return in;
+}
 
-        if ((chunk_id == MZIP_FILEINFO_CHUNK_ID) && (chunk_size > 10) &&
-            (chunk_size < BLOCK_SIZE)) {
-            if (fread(buffer, 1, chunk_size, in) != chunk_size) {
-                fprintf(stderr, "Error: failed to read file info chunk\n");
-                goto cleanup;
-            }
-            uint32_t checksum = update_adler32(1L, buffer, chunk_size);
+/* --trace=json prints one JSON line per data or hole chunk to stdout and a
+ * summary line at the end. Times are in nanoseconds: compress/decompress is
+ * the lz77 call, checksum the Adler-32 of the compressed payload, and I/O
+ * wait the reads and writes of the chunk. Totals are summed over threads, so
+ * they can exceed the wall time.
+ */
+struct mzip_trace {
+    bool enabled;
+    const char *tool, *codec; /* codec: name of the codec time field */
+    uint64_t start_ns;
+    uint64_t chunks, raw_bytes, compressed_bytes;
+    uint64_t codec_ns, checksum_ns, io_ns;
+};
 
-            if (checksum != chunk_checksum) {
-                fprintf(stderr, "\nError: checksum mismatch!\n");
-                fprintf(stderr, "Got %08X Expecting %08X\n", checksum,
-                        chunk_checksum);
-                goto cleanup;
-            }
+/* USDT probes, provider "mzip", built along with those of lz77.h:
+ *   chunk__read(offset, bytes, ns)   mzip read a chunk of an input file,
+ *                                    munzip a compressed chunk of the archive
+ *   chunk__write(offset, bytes, ns)  mzip appended a compressed chunk to the
+ *                                    archive, munzip wrote a chunk's output
+ * bytes counts what was read or written, offset is the chunk's offset in its
+ * member except for munzip reads, which give the archive offset; ns is the
+ * time the read or write took.
+ */
+#if LZ77_HAVE_USDT
+#define MZIP_PROBE3(name, a, b, c) DTRACE_PROBE3(mzip, name, a, b, c)
+#else
+#define MZIP_PROBE3(name, a, b, c) ((void) 0)
+#endif
 
-            total_extracted = 0;
-            decompressed_size = read_u32(buffer);
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
 
-            size_t fname_len = read_u16(buffer + 8);
-            if (fname_len > chunk_size - MZIP_FILEINFO_FIXED_SIZE)
-                fname_len = chunk_size - 10;
+static void trace_start(struct mzip_trace *trace, bool compress)
+{
+    trace->tool = compress ? "mzip" : "munzip";
+    trace->codec = compress ? "compress_ns" : "decompress_ns";
+    trace->start_ns = now_ns();
+}
 
-            free(ofile_name);
-            ofile_name = malloc(fname_len + 1);
-            if (!ofile_name) {
-                fprintf(stderr,
-                        "Error: cannot allocate output filename buffer\n");
-                goto cleanup;
-            }
-            memset(ofile_name, 0, fname_len + 1);
-            for (int c = 0; c < fname_len; c++)
-                ofile_name[c] = buffer[10 + c];
+/* Member names are printed as JSON strings; other bytes pass unchanged */
+static void trace_name(FILE *out, const char *name)
+{
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *) name; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputc('"', out);
+}
 
-            /* Validate filename for security (prevent path traversal) */
-            if (!is_safe_filename(ofile_name)) {
-                fprintf(stderr,
-                        "Error: unsafe filename '%s' rejected (potential path "
-                        "traversal attack)\n",
-                        ofile_name);
-                goto cleanup;
-            }
+/* Print one chunk record and add it to the totals; callers serialize this */
+static void trace_chunk(struct mzip_trace *trace,
+                        const char *member,
+                        uint64_t offset,
+                        uint64_t raw_size,
+                        uint32_t compressed_size,
+                        bool hole,
+                        uint64_t codec_ns,
+                        uint64_t checksum_ns,
+                        uint64_t io_ns)
+{
+    printf("{\"tool\":\"%s\",\"member\":", trace->tool);
+    trace_name(stdout, member);
+    printf(",\"offset\":%llu,\"raw_size\":%llu,\"compressed_size\":%u,"
+           "\"hole\":%s,\"%s\":%llu,\"checksum_ns\":%llu,"
+           "\"io_wait_ns\":%llu}\n",
+           (unsigned long long) offset, (unsigned long long) raw_size,
+           compressed_size, hole ? "true" : "false", trace->codec,
+           (unsigned long long) codec_ns, (unsigned long long) checksum_ns,
+           (unsigned long long) io_ns);
+
+    trace->chunks++;
+    trace->raw_bytes += raw_size;
+    trace->compressed_bytes += compressed_size;
+    trace->codec_ns += codec_ns;
+    trace->checksum_ns += checksum_ns;
+    trace->io_ns += io_ns;
+}
 
-            /* Create file exclusively (fails if already exists) */
-            /* Note: "wx" mode is C11, falls back to manual check for C99 */
-#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
-            out = fopen(ofile_name, "wbx");
-            if (!out) {
-                fprintf(
-                    stderr,
-                    "File %s already exists or cannot be created. Skipped.\n",
-                    ofile_name);
-                goto cleanup;
-            }
-#else
-            /* C99 fallback: check then create (minor TOCTOU window) */
-            out = fopen(ofile_name, "rb");
-            if (out) {
-                fprintf(stderr, "File %s already exists. Skipped.\n",
-                        ofile_name);
-                fclose(out);
-                out = NULL;
-                goto cleanup;
-            }
-            out = fopen(ofile_name, "wb");
-            if (!out) {
-                fprintf(stderr, "Can't create file %s. Skipped.\n", ofile_name);
-                goto cleanup;
-            }
-#endif
-        }
+static void trace_summary(const struct mzip_trace *trace, int jobs, int status)
+{
+    uint64_t wall = now_ns() - trace->start_ns;
+    printf("{\"tool\":\"%s\",\"summary\":true,\"status\":\"%s\","
+           "\"threads\":%d,\"chunks\":%llu,\"raw_bytes\":%llu,"
+           "\"compressed_bytes\":%llu,\"wall_ns\":%llu,\"%s\":%llu,"
+           "\"checksum_ns\":%llu,\"io_wait_ns\":%llu,\"mb_per_s\":%.1f}\n",
+           trace->tool, status == 0 ? "ok" : "error", jobs,
+           (unsigned long long) trace->chunks,
+           (unsigned long long) trace->raw_bytes,
+           (unsigned long long) trace->compressed_bytes,
+           (unsigned long long) wall, trace->codec,
+           (unsigned long long) trace->codec_ns,
+           (unsigned long long) trace->checksum_ns,
+           (unsigned long long) trace->io_ns,
+           wall ? (double) trace->raw_bytes * 1000.0 / (double) wall : 0.0);
+    fflush(stdout);
+}
 
-        if ((chunk_id == MZIP_DATA_CHUNK_ID) && out && ofile_name &&
-            decompressed_size) {
-            /* Enforce resource limits to prevent zip-bomb attacks */
-            if (chunk_size > MAX_COMPRESSED_CHUNK) {
-                fprintf(stderr,
-                        "Error: compressed chunk size %u exceeds limit %u\n",
-                        chunk_size, MAX_COMPRESSED_CHUNK);
-                goto cleanup;
-            }
-            if (chunk_extra > MAX_DECOMPRESSED_CHUNK) {
-                fprintf(stderr,
-                        "Error: decompressed chunk size %u exceeds limit %u\n",
-                        chunk_extra, MAX_DECOMPRESSED_CHUNK);
-                goto cleanup;
-            }
+/* Files are compressed by a pool of worker threads. Files smaller than
+ * TASK_SIZE are batched into one task, larger files are split into tasks of
+ * TASK_SIZE bytes. Either way every member is stored as BLOCK_SIZE data
+ * chunks, so the archive does not depend on the number of threads.
+ */
+#define TASK_SIZE (8 * BLOCK_SIZE)
+#define TASK_MAX_FILES 256
+#define TASKS_PER_WORKER 4 /* in-flight tasks bound memory use */
+
+/* Holes shorter than this are compressed as ordinary (zero) data */
+#define MIN_HOLE_SIZE BLOCK_SIZE
+
+/* Compressed data chunk produced by a worker; data is NULL for a hole */
+struct pack_chunk {
+    uint8_t *data;
+    uint32_t size;
+    uint64_t raw_size;
+    uint64_t offset;               /* of the raw data in the member */
+    uint64_t read_ns, compress_ns; /* for --trace */
+};
 
-            /* enlarge input buffer if necessary */
-            if (chunk_size > compressed_bufsize) {
-                compressed_bufsize = chunk_size;
-                uint8_t *tmp = realloc(compressed_buffer, compressed_bufsize);
-                if (!tmp) {
-                    fprintf(stderr,
-                            "Error: cannot allocate compressed buffer\n");
-                    goto cleanup;
-                }
-                compressed_buffer = tmp;
-            }
+/* Byte range [offset, offset + length) of one member */
+struct pack_entry {
+    char *path;
+    size_t member; /* index in the archive directory */
+    uint64_t size; /* file size when the tree was walked */
+    uint64_t offset, length;
+    bool hole; /* range is a hole, nothing to read */
+    size_t first_chunk, nchunks;
+};
 
-            /* enlarge output buffer if necessary */
-            if (chunk_extra > decompressed_bufsize) {
-                decompressed_bufsize = chunk_extra;
-                uint8_t *tmp =
-                    realloc(decompressed_buffer, decompressed_bufsize);
-                if (!tmp) {
-                    fprintf(stderr,
-                            "Error: cannot allocate decompressed buffer\n");
-                    goto cleanup;
-                }
-                decompressed_buffer = tmp;
-            }
+struct pack_task {
+    struct pack_entry *entries;
+    size_t nentries;
+    uint64_t bytes;
+    struct pack_chunk *chunks;
+    size_t nchunks, chunks_capacity;
+    bool done;
+    int status;
+};
 
-            /* read and check checksum */
-            if (!compressed_buffer ||
-                fread(compressed_buffer, 1, chunk_size, in) != chunk_size) {
-                fprintf(stderr, "Error: cannot read compressed chunk\n");
-                goto cleanup;
-            }
-            uint32_t checksum =
-                update_adler32(1L, compressed_buffer, chunk_size);
-            total_extracted += chunk_extra;
-
-            /* verify that the chunk data is correct */
-            if (checksum != chunk_checksum) {
-                fprintf(stderr, "\nError: checksum mismatch. Skipped.\n");
-                fprintf(stderr, "Got %08X Expecting %08X\n", checksum,
-                        chunk_checksum);
-                goto cleanup;
-            } else {
-                /* decompress and verify */
-                uint32_t remaining =
-                    lz77_decompress(compressed_buffer, chunk_size,
-                                    decompressed_buffer, chunk_extra);
-                if (remaining != chunk_extra) {
-                    fprintf(stderr,
-                            "\nError: decompression failed. Skipped.\n");
-                    goto cleanup;
-                } else {
-                    fwrite(decompressed_buffer, 1, chunk_extra, out);
-                }
-            }
-        }
+/* Per-worker FIFO task queue. Tasks are submitted round-robin; a worker
+ * takes the oldest task of its own queue, and when that is empty the oldest
+ * of the next non-empty one, so the in-order writer is never starved by
+ * freshly submitted work.
+ */
+struct pack_queue {
+    pthread_mutex_t lock;
+    struct pack_task **tasks; /* ring buffer */
+    size_t head, count, capacity;
+};
 
-        /* position of next chunk */
-        fseek(in, pos + 16 + chunk_size, SEEK_SET);
-    }
+struct pack_pool {
+    struct pack_queue *queues;
+    pthread_t *threads;
+    int nworkers, started;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    size_t queued; /* tasks in queues not yet claimed by a worker */
+    bool shutdown;
+};
 
-    status = 0;
+struct pack_worker {
+    struct pack_pool *pool;
+    int id;
+};
 
-cleanup:
-    free(compressed_buffer);
-    free(decompressed_buffer);
-    free(ofile_name);
-    if (out)
-        fclose(out);
-    if (in)
-        fclose(in);
+static void pack_task_free(struct pack_task *task)
+{
+    if (!task)
+        return;
+    for (size_t i = 0; i < task->nentries; i++)
+        free(task->entries[i].path);
+    for (size_t i = 0; i < task->nchunks; i++)
+        free(task->chunks[i].data);
+    free(task->entries);
+    free(task->chunks);
+    free(task);
+}
 
-    return status;
+static struct pack_task *queue_pop(struct pack_queue *queue)
+{
+    struct pack_task *task = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count) {
+        task = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return task;
 }
 
-static int decompress(int argc, char **argv)
+/* Wait for a task, preferring the worker's own queue over the others */
+static struct pack_task *pool_take(struct pack_pool *pool, int self)
 {
-    /* Handle common arguments (-h, --help, -v, --version, unknown options) */
-    int result = handle_common_args(argc, argv, false);
-    if (result <= 0)
-        return result; /* 0 = help/version shown, -1 = error */
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->queued && !pool->shutdown)
+        pthread_cond_wait(&pool->work, &pool->lock);
+    if (!pool->queued) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    pool->queued--; /* a task is now reserved for this worker */
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int k = 0;; k = (k + 1) % pool->nworkers) {
+        struct pack_task *task =
+            queue_pop(&pool->queues[(self + k) % pool->nworkers]);
+        if (task)
+            return task;
+    }
+}
+
+static void pool_submit(struct pack_pool *pool,
+                        struct pack_task *task,
+                        size_t seq)
+{
+    struct pack_queue *queue = &pool->queues[seq % pool->nworkers];
+    pthread_mutex_lock(&queue->lock);
+    queue->tasks[(queue->head + queue->count) % queue->capacity] = task;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static bool pack_add_chunk(struct pack_task *task,
+                           const uint8_t *data,
+                           uint32_t size,
+                           uint64_t raw_size)
+{
+    if (task->nchunks == task->chunks_capacity) {
+        size_t capacity = task->chunks_capacity ? task->chunks_capacity * 2 : 8;
+        struct pack_chunk *tmp =
+            realloc(task->chunks, capacity * sizeof(*tmp));
+        if (!tmp)
+            return false;
+        task->chunks = tmp;
+        task->chunks_capacity = capacity;
+    }
+
+    uint8_t *copy = NULL;
+    if (data) {
+        if (!(copy = malloc(size)))
+            return false;
+        memcpy(copy, data, size);
+    }
+    task->chunks[task->nchunks++] =
+        (struct pack_chunk){.data = copy, .size = size, .raw_size = raw_size};
+    return true;
+}
+
+/* Read and compress one entry of a task, BLOCK_SIZE bytes at a time */
+static int pack_entry_compress(struct pack_task *task,
+                               struct pack_entry *entry,
+                               uint8_t *buffer,
+                               uint8_t *result,
+                               void *workmem)
+{
+    if (entry->hole) {
+        entry->first_chunk = task->nchunks;
+        entry->nchunks = 1;
+        if (!pack_add_chunk(task, NULL, 0, entry->length)) {
+            fprintf(stderr, "Error: cannot allocate compressed chunk\n");
+            return -1;
+        }
+        task->chunks[entry->first_chunk].offset = entry->offset;
+        return 0;
+    }
+
+    int fd = open(entry->path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: could not open %s\n", entry->path);
+        return -1;
+    }
+
+    entry->first_chunk = task->nchunks;
+    uint64_t total_read = 0;
+    int status = 0;
+    while (total_read < entry->length) {
+        size_t want = entry->length - total_read < BLOCK_SIZE
+                          ? entry->length - total_read
+                          : BLOCK_SIZE;
+        size_t bytes_read = 0;
+        uint64_t start = now_ns();
+        while (bytes_read < want) {
+            ssize_t n = pread(fd, buffer + bytes_read, want - bytes_read,
+                              entry->offset + total_read + bytes_read);
+            if (n <= 0)
+                break;
+            bytes_read += n;
+        }
+        uint64_t read_done = now_ns();
+        MZIP_PROBE3(chunk__read, entry->offset + total_read, bytes_read,
+                    read_done - start);
+        total_read += bytes_read;
+        if (bytes_read < want)
+            break;
+
+        if (entry->offset == 0 && total_read == bytes_read &&
+            bytes_read >= MZIP_MAGIC_SIZE &&
+            !memcmp(buffer, mzip_magic, MZIP_MAGIC_SIZE)) {
+            printf("Error: file %s is already a mzip archive!\n", entry->path);
+            status = -1;
+            break;
+        }
+
+        int chunk_size = lz77_compress(buffer, bytes_read, result, workmem);
+        uint64_t compress_done = now_ns();
+        if (chunk_size <= 0 || chunk_size > 2 * BLOCK_SIZE) {
+            fprintf(stderr,
+                    "Error: compression failed or returned invalid size %d\n",
+                    chunk_size);
+            status = -1;
+            break;
+        }
+        if (!pack_add_chunk(task, result, chunk_size, bytes_read)) {
+            fprintf(stderr, "Error: cannot allocate compressed chunk\n");
+            status = -1;
+            break;
+        }
+        struct pack_chunk *chunk = &task->chunks[task->nchunks - 1];
+        chunk->offset = entry->offset + total_read - bytes_read;
+        chunk->read_ns = read_done - start;
+        chunk->compress_ns = compress_done - read_done;
+    }
+
+    /* the last range of a file must end exactly at end of file */
+    uint8_t probe;
+    if (status == 0 &&
+        (total_read != entry->length ||
+         (entry->offset + entry->length == entry->size &&
+          pread(fd, &probe, 1, entry->size) != 0))) {
+        fprintf(stderr,
+                "Error: reading %s failed (read %llu bytes, expected %llu)!\n",
+                entry->path,
+                (unsigned long long) (entry->offset + total_read),
+                (unsigned long long) (entry->offset + entry->length));
+        status = -1;
+    }
+
+    entry->nchunks = task->nchunks - entry->first_chunk;
+    close(fd);
+    return status;
+}
+
+static void *pack_worker(void *arg)
+{
+    struct pack_worker *worker = arg;
+    struct pack_pool *pool = worker->pool;
+    uint8_t *buffer = malloc(BLOCK_SIZE);
+    uint8_t *result = malloc(2 * BLOCK_SIZE);
+    void *workmem = malloc(LZ77_WORKMEM_SIZE);
+
+    struct pack_task *task;
+    while ((task = pool_take(pool, worker->id))) {
+        if (!buffer || !result || !workmem) {
+            fprintf(stderr, "Error: cannot allocate compression buffers\n");
+            task->status = -1;
+        }
+        for (size_t i = 0; i < task->nentries && task->status == 0; i++) {
+            task->status = pack_entry_compress(task, &task->entries[i], buffer,
+                                               result, workmem);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        task->done = true;
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    free(buffer);
+    free(result);
+    free(workmem);
+    return NULL;
+}
+
+static void write_fileinfo(FILE *ofile, const struct mzip_member *member)
+{
+    size_t name_len = strlen(member->name) + 1;
+    uint8_t buffer[MZIP_FILEINFO_FIXED_SIZE], base[8];
+    put_u64(buffer, member->size);
+    put_u16(buffer + 8, name_len);
+    put_u64(base, member->base);
+
+    bool segment = member->flags & MZIP_MEMBER_SEGMENT;
+    uint32_t checksum = update_adler32(1L, buffer, sizeof(buffer));
+    checksum = update_adler32(checksum, member->name, name_len);
+    if (segment)
+        checksum = update_adler32(checksum, base, sizeof(base));
+    write_chunk_header(ofile, MZIP_FILEINFO_CHUNK_ID,
+                       segment ? MZIP_FILEINFO_SEGMENT : 0,
+                       sizeof(buffer) + name_len + (segment ? sizeof(base) : 0),
+                       checksum, 0);
+    fwrite(buffer, sizeof(buffer), 1, ofile);
+    fwrite(member->name, name_len, 1, ofile);
+    if (segment)
+        fwrite(base, sizeof(base), 1, ofile);
+}
+
+/* Producer/writer state: tasks are submitted in archive order and written
+ * back in the same order once their worker is done with them.
+ */
+struct pack_state {
+    struct pack_pool pool;
+    struct pack_worker *workers;
+    FILE *ofile;
+    struct mzip_directory *dir;
+    size_t first_new; /* directory entries before it were already stored */
+    uint64_t stored_end; /* where the chunks of those entries end */
+    bool verify;         /* compare all stored bytes of grown members */
+    struct pack_task **window; /* in-flight tasks, oldest first */
+    size_t window_size, window_head, inflight;
+    size_t submitted;
+    struct pack_task *batch; /* small files not yet submitted */
+    struct mzip_trace trace;
+    int status;
+};
+
+/* Wait for the oldest in-flight task and append its chunks to the archive */
+static int pack_write_next(struct pack_state *state)
+{
+    struct pack_task *task = state->window[state->window_head];
+
+    pthread_mutex_lock(&state->pool.lock);
+    while (!task->done)
+        pthread_cond_wait(&state->pool.done, &state->pool.lock);
+    pthread_mutex_unlock(&state->pool.lock);
+
+    state->window_head = (state->window_head + 1) % state->window_size;
+    state->inflight--;
+
+    if (task->status < 0)
+        state->status = -1;
+
+    for (size_t i = 0; i < task->nentries && state->status == 0; i++) {
+        const struct pack_entry *entry = &task->entries[i];
+        struct mzip_member *member = &state->dir->members[entry->member];
+
+        if (entry->offset == member->base) {
+            off_t offset = ftello(state->ofile);
+            if (offset < 0) {
+                fprintf(stderr, "Error: cannot record member %s\n",
+                        member->name);
+                state->status = -1;
+                break;
+            }
+            member->offset = offset;
+            write_fileinfo(state->ofile, member);
+        }
+
+        for (size_t c = 0; c < entry->nchunks; c++) {
+            const struct pack_chunk *chunk =
+                &task->chunks[entry->first_chunk + c];
+            if (!chunk->data) {
+                uint8_t payload[MZIP_HOLE_PAYLOAD_SIZE];
+                put_u64(payload, chunk->raw_size);
+                write_chunk_header(state->ofile, MZIP_HOLE_CHUNK_ID, 0,
+                                   sizeof(payload),
+                                   update_adler32(1L, payload, sizeof(payload)),
+                                   0);
+                fwrite(payload, 1, sizeof(payload), state->ofile);
+                member->chunks++;
+                if (state->trace.enabled)
+                    trace_chunk(&state->trace, member->name, chunk->offset,
+                                chunk->raw_size, 0, true, 0, 0, 0);
+                continue;
+            }
+            uint64_t start = now_ns();
+            uint32_t checksum = update_adler32(1L, chunk->data, chunk->size);
+            uint64_t checksum_done = now_ns();
+            write_chunk_header(state->ofile, MZIP_DATA_CHUNK_ID, 1, chunk->size,
+                               checksum, chunk->raw_size);
+            fwrite(chunk->data, 1, chunk->size, state->ofile);
+            uint64_t write_done = now_ns();
+            MZIP_PROBE3(chunk__write, chunk->offset, chunk->size,
+                        write_done - checksum_done);
+            member->chunks++;
+            if (state->trace.enabled)
+                trace_chunk(&state->trace, member->name, chunk->offset,
+                            chunk->raw_size, chunk->size, false,
+                            chunk->compress_ns, checksum_done - start,
+                            chunk->read_ns + write_done - checksum_done);
+        }
+    }
+
+    pack_task_free(task);
+    return state->status;
+}
+
+static int pack_submit(struct pack_state *state, struct pack_task *task)
+{
+    while (state->inflight == state->window_size && state->status == 0)
+        pack_write_next(state);
+    if (state->status < 0) {
+        pack_task_free(task);
+        return -1;
+    }
+
+    size_t slot =
+        (state->window_head + state->inflight) % state->window_size;
+    state->window[slot] = task;
+    state->inflight++;
+    pool_submit(&state->pool, task, state->submitted++);
+    return 0;
+}
+
+static struct pack_task *pack_task_new(size_t max_entries)
+{
+    struct pack_task *task = calloc(1, sizeof(*task));
+    if (task)
+        task->entries = calloc(max_entries, sizeof(*task->entries));
+    if (!task || !task->entries) {
+        free(task);
+        return NULL;
+    }
+    return task;
+}
+
+static int pack_flush_batch(struct pack_state *state)
+{
+    struct pack_task *batch = state->batch;
+    state->batch = NULL;
+    return batch ? pack_submit(state, batch) : 0;
+}
+
+/* Find the first hole of at least MIN_HOLE_SIZE bytes at or after offset.
+ * On success, [*hole_start, *hole_end) is the hole; returns false when the
+ * rest of the file is data or the file system does not report holes.
+ */
+static bool next_hole(int fd,
+                      uint64_t offset,
+                      uint64_t size,
+                      uint64_t *hole_start,
+                      uint64_t *hole_end)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    while (offset < size) {
+        off_t start = lseek(fd, offset, SEEK_HOLE);
+        if (start < 0 || (uint64_t) start >= size)
+            return false;
+
+        /* no data after the hole (ENXIO) means it extends to end of file */
+        off_t end = lseek(fd, start, SEEK_DATA);
+        if (end < 0 || (uint64_t) end > size)
+            end = size;
+
+        if ((uint64_t) (end - start) >= MIN_HOLE_SIZE) {
+            *hole_start = start;
+            *hole_end = end;
+            return true;
+        }
+        offset = end;
+    }
+#else
+    (void) fd, (void) offset, (void) size, (void) hole_start, (void) hole_end;
+#endif
+    return false;
+}
+
+static int pack_submit_range(struct pack_state *state,
+                             const char *path,
+                             size_t member,
+                             uint64_t size,
+                             uint64_t offset,
+                             uint64_t length,
+                             bool hole)
+{
+    struct pack_task *task = pack_task_new(1);
+    if (!task || !(task->entries[0].path = strdup(path))) {
+        pack_task_free(task);
+        fprintf(stderr, "Error: cannot allocate task\n");
+        return -1;
+    }
+    task->entries[0] = (struct pack_entry){
+        .path = task->entries[0].path,
+        .member = member,
+        .size = size,
+        .offset = offset,
+        .length = length,
+        .hole = hole,
+    };
+    task->nentries = 1;
+    task->bytes = hole ? 0 : length;
+    return pack_submit(state, task);
+}
+
+/* Data or hole chunk of a member, as found by read_member_chunk() */
+struct member_chunk {
+    uint64_t pos;    /* archive offset of the payload */
+    uint64_t length; /* bytes of output */
+    uint32_t size, checksum;
+    bool hole;
+};
+
+/* Read and validate the member chunk at *pos, which must fit in the remaining
+ * size bytes of the member, and advance *pos past it. Returns 1 for a data or
+ * hole chunk, 0 for any other chunk, -1 on errors.
+ */
+static int read_member_chunk(FILE *in,
+                             uint64_t fsize,
+                             const struct mzip_member *member,
+                             uint64_t *pos,
+                             uint64_t remaining,
+                             struct member_chunk *chunk)
+{
+    uint16_t chunk_id, chunk_options;
+    uint32_t chunk_size, chunk_checksum, chunk_extra;
+    if (fseeko(in, *pos, SEEK_SET) != 0 ||
+        !read_chunk_header(in, &chunk_id, &chunk_options, &chunk_size,
+                           &chunk_checksum, &chunk_extra)) {
+        fprintf(stderr, "Error: failed to read chunk header\n");
+        return -1;
+    }
+    uint64_t payload = *pos + MZIP_CHUNK_HEADER_SIZE;
+
+    if (chunk_id == MZIP_HOLE_CHUNK_ID) {
+        uint8_t hole[MZIP_HOLE_PAYLOAD_SIZE];
+        if (chunk_size != sizeof(hole) ||
+            fread(hole, 1, sizeof(hole), in) != sizeof(hole) ||
+            update_adler32(1L, hole, sizeof(hole)) != chunk_checksum) {
+            fprintf(stderr, "Error: damaged hole chunk in %s\n", member->name);
+            return -1;
+        }
+        chunk->length = read_u64(hole);
+        if (chunk->length > remaining) {
+            fprintf(stderr, "Error: invalid hole in %s\n", member->name);
+            return -1;
+        }
+        chunk->hole = true;
+    } else if (chunk_id == MZIP_DATA_CHUNK_ID) {
+        /* Enforce resource limits to prevent zip-bomb attacks */
+        if (chunk_size > MAX_COMPRESSED_CHUNK) {
+            fprintf(stderr,
+                    "Error: compressed chunk size %u exceeds limit %u\n",
+                    chunk_size, MAX_COMPRESSED_CHUNK);
+            return -1;
+        }
+        if (chunk_extra > MAX_DECOMPRESSED_CHUNK) {
+            fprintf(stderr,
+                    "Error: decompressed chunk size %u exceeds limit %u\n",
+                    chunk_extra, MAX_DECOMPRESSED_CHUNK);
+            return -1;
+        }
+        if (chunk_extra > remaining || chunk_size > fsize - payload) {
+            fprintf(stderr, "Error: %s has an invalid data chunk\n",
+                    member->name);
+            return -1;
+        }
+        chunk->length = chunk_extra;
+        chunk->hole = false;
+    } else {
+        return 0;
+    }
+
+    chunk->pos = payload;
+    chunk->size = chunk_size;
+    chunk->checksum = chunk_checksum;
+    *pos = payload + chunk_size;
+    return 1;
+}
+
+/* Compare one stored entry, or only its last chunk, with the bytes of the
+ * file it covers. buffer holds 4 * BLOCK_SIZE bytes. Returns 1 on a match, 0
+ * if the file differs, -1 on errors.
+ */
+static int stored_entry_matches(FILE *in,
+                                uint64_t end,
+                                const struct mzip_member *member,
+                                FILE *file,
+                                uint8_t *buffer,
+                                bool tail_only)
+{
+    uint8_t *compressed = buffer, *stored = buffer + 2 * BLOCK_SIZE;
+    uint8_t *current = stored + BLOCK_SIZE;
+    uint16_t id, options;
+    uint32_t size, checksum, extra;
+    if (fseeko(in, member->offset, SEEK_SET) != 0 ||
+        !read_chunk_header(in, &id, &options, &size, &checksum, &extra) ||
+        id != MZIP_FILEINFO_CHUNK_ID || size >= BLOCK_SIZE) {
+        fprintf(stderr, "Error: failed to read file info chunk of %s\n",
+                member->name);
+        return -1;
+    }
+
+    uint64_t pos = member->offset + MZIP_CHUNK_HEADER_SIZE + size;
+    uint64_t out_offset = 0;
+    uint32_t chunks = 0;
+    while (pos < end && chunks < member->chunks) {
+        struct member_chunk chunk;
+        int found = read_member_chunk(in, end, member, &pos,
+                                      member->size - out_offset, &chunk);
+        if (found < 0)
+            return -1;
+        if (!found)
+            break;
+        if (tail_only && chunks + 1 < member->chunks) {
+            out_offset += chunk.length;
+            chunks++;
+            continue;
+        }
+
+        /* mzip writes data chunks of at most BLOCK_SIZE bytes */
+        int n;
+        if (chunk.hole) {
+            memset(stored, 0, BLOCK_SIZE);
+        } else if (chunk.length > BLOCK_SIZE || chunk.size > 2 * BLOCK_SIZE ||
+                   fseeko(in, chunk.pos, SEEK_SET) != 0 ||
+                   fread(compressed, 1, chunk.size, in) != chunk.size ||
+                   update_adler32(1L, compressed, chunk.size) !=
+                       chunk.checksum ||
+                   (n = lz77_decompress(compressed, chunk.size, stored,
+                                        BLOCK_SIZE)) < 0 ||
+                   (uint64_t) n != chunk.length) {
+            fprintf(stderr, "Error: damaged data chunk in %s\n",
+                    member->name);
+            return -1;
+        }
+
+        uint64_t offset = member->base + out_offset;
+        for (uint64_t done = 0; done < chunk.length;) {
+            size_t n = chunk.length - done < BLOCK_SIZE
+                           ? chunk.length - done
+                           : BLOCK_SIZE;
+            if (fseeko(file, offset + done, SEEK_SET) != 0 ||
+                fread(current, 1, n, file) != n ||
+                memcmp(current, chunk.hole ? stored : stored + done, n))
+                return 0;
+            done += n;
+        }
+        out_offset += chunk.length;
+        chunks++;
+    }
+
+    if (out_offset != member->size || chunks != member->chunks) {
+        fprintf(stderr, "Error: %s is truncated (%llu of %llu bytes)\n",
+                member->name, (unsigned long long) out_offset,
+                (unsigned long long) member->size);
+        return -1;
+    }
+    return 1;
+}
+
+/* Check that a file still starts with the bytes archived for the stored
+ * member first. Only the last chunk of its last entry is compared, which
+ * catches rotated and rewritten logs at the cost of one chunk; with --verify
+ * every entry is. Returns 1 on a match, 0 if the file was rewritten, -1 on
+ * errors. The archive is left at the position it had.
+ */
+static int stored_prefix_matches(struct pack_state *state,
+                                 const char *path,
+                                 struct mzip_member *first)
+{
+    off_t where = ftello(state->ofile);
+    FILE *file = fopen(path, "rb");
+    uint8_t *buffer = malloc(4 * BLOCK_SIZE);
+    int ret = where < 0 || !file || !buffer ? -1 : 1;
+    if (ret < 0)
+        fprintf(stderr, "Error: cannot compare %s with its archived copy\n",
+                path);
+
+    const struct mzip_member *stored = state->dir->members + state->first_new;
+    for (struct mzip_member *member = first; ret == 1 && member;) {
+        struct mzip_member *next = directory_find_next(state->dir, member);
+        if (next && next >= stored)
+            next = NULL; /* added by this run */
+        if (state->verify || !next)
+            ret = stored_entry_matches(state->ofile, state->stored_end, member,
+                                       file, buffer, !state->verify);
+        member = next;
+    }
+
+    if (where >= 0 && fseeko(state->ofile, where, SEEK_SET) != 0) {
+        fprintf(stderr, "Error: cannot seek in the archive\n");
+        ret = -1;
+    }
+    free(buffer);
+    if (file)
+        fclose(file);
+    return ret;
+}
+
+/* Register a file as archive member and queue the tasks covering it. Files
+ * of TASK_SIZE bytes or more are checked for holes, which are stored as hole
+ * chunks instead of compressed zeros.
+ *
+ * When appending, a file matching a stored member is taken to have grown:
+ * only the bytes past the stored size are added, as a segment of that member.
+ * The stored bytes must still be the start of the file; a rewritten file is
+ * refused rather than archived as a mix of old and new contents.
+ */
+static int pack_add_file(struct pack_state *state,
+                         const char *path,
+                         const char *name,
+                         uint64_t size)
+{
+    struct mzip_member *first = directory_find(state->dir, name);
+    uint64_t start = 0;
+    if (first) {
+        if ((size_t) (first - state->dir->members) >= state->first_new) {
+            fprintf(stderr, "Error: duplicate member name %s\n", name);
+            return -1;
+        }
+        if (size < first->total) {
+            fprintf(stderr,
+                    "Error: %s is smaller than its archived copy, cannot "
+                    "append\n",
+                    path);
+            return -1;
+        }
+        int match = stored_prefix_matches(state, path, first);
+        if (match < 0)
+            return -1;
+        if (!match) {
+            fprintf(stderr,
+                    "Error: %s no longer matches its archived copy, cannot "
+                    "append\n",
+                    path);
+            return -1;
+        }
+        if (size == first->total)
+            return 0; /* nothing new */
+        start = first->total;
+    }
+
+    struct mzip_member *member = directory_add(state->dir, name);
+    if (!member) {
+        fprintf(stderr, "Error: cannot record member %s\n", name);
+        return -1;
+    }
+    /* directory_add may have moved the member array */
+    if (start) {
+        first = directory_find(state->dir, name);
+        first->total = size;
+        member->flags = MZIP_MEMBER_SEGMENT;
+    } else {
+        member->total = size;
+    }
+    member->base = start;
+    member->size = size - start;
+    size_t index = member - state->dir->members;
+
+    /* small files share a batch task, large files are split */
+    if (size - start < TASK_SIZE) {
+        if (state->batch && (state->batch->nentries == TASK_MAX_FILES ||
+                             state->batch->bytes + size - start > TASK_SIZE)) {
+            if (pack_flush_batch(state) < 0)
+                return -1;
+        }
+        if (!state->batch && !(state->batch = pack_task_new(TASK_MAX_FILES))) {
+            fprintf(stderr, "Error: cannot allocate task\n");
+            return -1;
+        }
+
+        struct pack_entry *entry =
+            &state->batch->entries[state->batch->nentries];
+        if (!(entry->path = strdup(path))) {
+            fprintf(stderr, "Error: cannot allocate task\n");
+            return -1;
+        }
+        entry->member = index;
+        entry->size = size;
+        entry->offset = start;
+        entry->length = size - start;
+        state->batch->nentries++;
+        state->batch->bytes += entry->length;
+        return 0;
+    }
+
+    /* keep members in order: submit pending small files first */
+    if (pack_flush_batch(state) < 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: could not open %s\n", path);
+        return -1;
+    }
+
+    uint64_t offset = start;
+    while (offset < size) {
+        uint64_t data_end = size, hole_end = size;
+        if (!next_hole(fd, offset, size, &data_end, &hole_end))
+            data_end = hole_end = size;
+
+        /* data up to the next hole, in TASK_SIZE pieces */
+        while (offset < data_end) {
+            uint64_t length =
+                data_end - offset < TASK_SIZE ? data_end - offset : TASK_SIZE;
+            if (pack_submit_range(state, path, index, size, offset, length,
+                                  false) < 0) {
+                close(fd);
+                return -1;
+            }
+            offset += length;
+        }
+
+        if (hole_end > offset) {
+            if (pack_submit_range(state, path, index, size, offset,
+                                  hole_end - offset, true) < 0) {
+                close(fd);
+                return -1;
+            }
+            offset = hole_end;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* Add the regular files below a directory, in sorted order. Member names are
+ * prefixed with the directory name relative to the walk root.
+ */
+static int pack_add_tree(struct pack_state *state,
+                         const char *path,
+                         const char *prefix)
+{
+    struct dirent **entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Error: could not read directory %s\n", path);
+        return -1;
+    }
+
+    int ret = 0;
+    for (int i = 0; i < n; i++) {
+        const char *base = entries[i]->d_name;
+        if (ret < 0 || !strcmp(base, ".") || !strcmp(base, "..")) {
+            free(entries[i]);
+            continue;
+        }
+
+        size_t path_len = strlen(path) + strlen(base) + 2;
+        size_t name_len = strlen(prefix) + strlen(base) + 2;
+        char *child = malloc(path_len), *name = malloc(name_len);
+        if (!child || !name) {
+            fprintf(stderr, "Error: cannot allocate path\n");
+            ret = -1;
+        } else {
+            snprintf(child, path_len, "%s%s%s", path,
+                     path[strlen(path) - 1] == '/' ? "" : "/", base);
+            snprintf(name, name_len, "%s%s%s", prefix, *prefix ? "/" : "",
+                     base);
+
+            struct stat st;
+            if (lstat(child, &st) != 0) {
+                fprintf(stderr, "Error: could not stat %s\n", child);
+                ret = -1;
+            } else if (S_ISDIR(st.st_mode)) {
+                ret = pack_add_tree(state, child, name);
+            } else if (S_ISREG(st.st_mode)) {
+                ret = pack_add_file(state, child, name, st.st_size);
+            } else {
+                fprintf(stderr, "Warning: skipping %s (not a regular file)\n",
+                        child);
+            }
+        }
+
+        free(child);
+        free(name);
+        free(entries[i]);
+    }
+    free(entries);
+    return ret;
+}
+
+static int pack_add_input(struct pack_state *state,
+                          const char *ifile,
+                          bool recursive)
+{
+    struct stat st;
+    if (stat(ifile, &st) != 0) {
+        printf("Error: could not open %s\n", ifile);
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (!recursive) {
+            fprintf(stderr, "Error: %s is a directory (use -r)\n", ifile);
+            return -1;
+        }
+
+        /* members are named after the last path component, e.g. "dir/"
+         * yields "dir/a.txt"; "." and ".." add no prefix
+         */
+        char *copy = strdup(ifile);
+        if (!copy) {
+            fprintf(stderr, "Error: cannot allocate path\n");
+            return -1;
+        }
+        size_t len = strlen(copy);
+        while (len > 1 && copy[len - 1] == '/')
+            copy[--len] = '\0';
+        const char *slash = strrchr(copy, '/');
+        const char *prefix = slash ? slash + 1 : copy;
+        if (!strcmp(prefix, ".") || !strcmp(prefix, "..") || !*prefix)
+            prefix = "";
+
+        int ret = pack_add_tree(state, ifile, prefix);
+        free(copy);
+        return ret;
+    }
+
+    /* truncate directory prefix, e.g. "/path/to/FILE.txt" becomes "FILE.txt" */
+    const char *slash = strrchr(ifile, '/');
+    const char *shown_name = slash ? slash + 1 : ifile;
+
+    /* size of non-regular inputs (e.g. /dev/stdin) is unknown up front */
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Error: %s is not a regular file\n", ifile);
+        return -1;
+    }
+
+    return pack_add_file(state, ifile, shown_name, st.st_size);
+}
+
+static int pool_start(struct pack_state *state, int jobs)
+{
+    struct pack_pool *pool = &state->pool;
+
+    state->window_size = (size_t) jobs * TASKS_PER_WORKER;
+    state->window = calloc(state->window_size, sizeof(*state->window));
+    state->workers = calloc(jobs, sizeof(*state->workers));
+    pool->queues = calloc(jobs, sizeof(*pool->queues));
+    pool->threads = calloc(jobs, sizeof(*pool->threads));
+    if (!state->window || !state->workers || !pool->queues || !pool->threads)
+        return -1;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->nworkers = jobs;
+    bool ok = true;
+    for (int i = 0; i < jobs; i++) {
+        struct pack_queue *queue = &pool->queues[i];
+        pthread_mutex_init(&queue->lock, NULL);
+        /* any queue may receive the whole window */
+        queue->capacity = state->window_size;
+        queue->tasks = calloc(queue->capacity, sizeof(*queue->tasks));
+        ok = ok && queue->tasks;
+    }
+    if (!ok)
+        return -1;
+
+    for (int i = 0; i < jobs; i++) {
+        state->workers[i] = (struct pack_worker){pool, i};
+        if (pthread_create(&pool->threads[i], NULL, pack_worker,
+                           &state->workers[i]))
+            break;
+        pool->started++;
+    }
+    return pool->started ? 0 : -1;
+}
+
+static void pool_stop(struct pack_state *state)
+{
+    struct pack_pool *pool = &state->pool;
+
+    /* drain tasks still in flight after an error */
+    while (state->inflight) {
+        state->status = -1;
+        pack_write_next(state);
+    }
+
+    if (pool->nworkers) {
+        pthread_mutex_lock(&pool->lock);
+        pool->shutdown = true;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < pool->started; i++)
+            pthread_join(pool->threads[i], NULL);
+
+        for (int i = 0; i < pool->nworkers; i++) {
+            pthread_mutex_destroy(&pool->queues[i].lock);
+            free(pool->queues[i].tasks);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->work);
+        pthread_cond_destroy(&pool->done);
+    }
+
+    pack_task_free(state->batch);
+    free(pool->queues);
+    free(pool->threads);
+    free(state->workers);
+    free(state->window);
+}
+
+/* Open an existing archive for appending: load its members and position the
+ * file where the old directory starts, so that only the directory and trailer
+ * are overwritten. *end receives that offset.
+ */
+static FILE *open_append(const char *ofile,
+                         struct mzip_directory *dir,
+                         uint64_t *end)
+{
+    FILE *file = fopen(ofile, "r+b");
+    if (!file)
+        return NULL;
+
+    off_t sz;
+    if (!detect_magic(file)) {
+        fprintf(stderr, "Error: file %s is not a mzip archive!\n", ofile);
+    } else if (fseeko(file, 0, SEEK_END) != 0 || (sz = ftello(file)) < 0) {
+        fprintf(stderr, "Error: could not determine size of %s\n", ofile);
+    } else if (read_members(file, sz, dir, end) == 0) {
+        if (fseeko(file, *end, SEEK_SET) == 0)
+            return file;
+        fprintf(stderr, "Error: cannot seek in %s\n", ofile);
+        directory_free(dir);
+    }
+
+    fclose(file);
+    return NULL;
+}
+
+static int pack_file(char **ifiles,
+                     int nfiles,
+                     const char *ofile,
+                     bool recursive,
+                     bool append,
+                     bool verify,
+                     int jobs,
+                     bool trace)
+{
+    /* Guard against NULL inputs */
+    if (!ifiles || nfiles <= 0 || !ofile) {
+        fprintf(stderr, "Error: NULL file path provided\n");
+        return -1;
+    }
+
+    struct mzip_directory dir = {0};
+    uint64_t end = 0;
+    FILE *file = fopen(ofile, "rb");
+    if (file) {
+        fclose(file);
+        if (!append) {
+            printf("Error: file %s already exists. Aborted.\n\n", ofile);
+            return -1;
+        }
+        if (!(file = open_append(ofile, &dir, &end))) {
+            printf("Error: could not append to %s. Aborted.\n\n", ofile);
+            return -1;
+        }
+    } else {
+        file = fopen(ofile, "wb");
+        if (!file) {
+            printf("Error: could not create %s. Aborted.\n\n", ofile);
+            return -1;
+        }
+        write_magic(file);
+    }
+
+    struct pack_state state = {
+        .ofile = file,
+        .dir = &dir,
+        .first_new = dir.count,
+        .stored_end = end,
+        .verify = verify,
+        .trace.enabled = trace,
+    };
+    trace_start(&state.trace, true);
+
+    if (jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (int) cpus : 1;
+    }
+
+    if (pool_start(&state, jobs) < 0) {
+        fprintf(stderr, "Error: cannot start compression threads\n");
+        state.status = -1;
+    }
+    for (int i = 0; i < nfiles && state.status == 0; i++) {
+        if (pack_add_input(&state, ifiles[i], recursive) < 0)
+            state.status = -1;
+    }
+    if (state.status == 0)
+        pack_flush_batch(&state);
+    while (state.inflight && state.status == 0)
+        pack_write_next(&state);
+    int ret = state.status;
+    pool_stop(&state);
+
+    /* a failed append leaves the archive as it was */
+    size_t count = dir.count;
+    if (ret < 0 && end) {
+        dir.count = state.first_new;
+        if (fflush(file) != 0 || ftruncate(fileno(file), end) != 0 ||
+            fseeko(file, end, SEEK_SET) != 0 ||
+            write_directory(file, &dir) < 0)
+            fprintf(stderr, "Error: could not restore %s\n", ofile);
+        dir.count = count;
+    } else if (ret == 0) {
+        ret = write_directory(file, &dir);
+    }
+
+    /* drop whatever followed an old directory that was overwritten */
+    off_t size = ftello(file);
+    if (end && (fflush(file) != 0 || size < 0 ||
+                ftruncate(fileno(file), size) != 0))
+        ret = -1;
+
+    directory_free(&dir);
+    if (fclose(file) != 0)
+        ret = -1;
+
+    if (trace)
+        trace_summary(&state.trace, jobs, ret);
+    return ret;
+}
+
+/* Copy a byte range between two files, inside the kernel when possible */
+static int copy_range(int in_fd,
+                      uint64_t in_offset,
+                      int out_fd,
+                      uint64_t out_offset,
+                      uint64_t length)
+{
+#if defined(__linux__)
+    while (length > 0) {
+        loff_t src = in_offset, dst = out_offset;
+        size_t want = length < (1U << 30) ? length : (1U << 30);
+        /* fall back to read/write, e.g. across file systems (EXDEV) */
+        ssize_t n = copy_file_range(in_fd, &src, out_fd, &dst, want, 0);
+        if (n <= 0)
+            break;
+        in_offset += n;
+        out_offset += n;
+        length -= n;
+    }
+#endif
+
+    uint8_t buffer[BLOCK_SIZE];
+    while (length > 0) {
+        size_t want = length < sizeof(buffer) ? length : sizeof(buffer);
+        ssize_t n = pread(in_fd, buffer, want, in_offset);
+        if (n <= 0)
+            return -1;
+        for (ssize_t done = 0; done < n;) {
+            ssize_t written =
+                pwrite(out_fd, buffer + done, n - done, out_offset + done);
+            if (written <= 0)
+                return -1;
+            done += written;
+        }
+        in_offset += n;
+        out_offset += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/* Splice the members of one archive onto the output. Runs of members are
+ * copied verbatim; a member whose name was already merged becomes a segment
+ * of it, and only its file info chunk is rewritten.
+ */
+static int merge_archive(FILE *ofile,
+                         const char *ifile,
+                         struct mzip_directory *merged)
+{
+    struct mzip_directory dir = {0};
+    uint64_t fsize, end;
+    FILE *in = open_archive(ifile, &fsize, &dir, &end);
+    if (!in)
+        return -1;
+
+    /* [copy_start, copy_end) of the input is pending at output offset pos */
+    off_t pos = fflush(ofile) == 0 ? ftello(ofile) : -1;
+    uint64_t copy_start = 0, copy_end = 0;
+    int in_fd = fileno(in), out_fd = fileno(ofile);
+    int ret = pos < 0 ? -1 : 0;
+
+    for (size_t i = 0; i < dir.count && ret == 0; i++) {
+        const struct mzip_member *member = &dir.members[i];
+        uint64_t member_end =
+            i + 1 < dir.count ? dir.members[i + 1].offset : end;
+        if (member_end <= member->offset || member_end > end) {
+            fprintf(stderr, "Error: damaged member list in %s\n", ifile);
+            ret = -1;
+            break;
+        }
+
+        struct mzip_member *first = directory_find(merged, member->name);
+        uint64_t base = first ? first->total : 0;
+        if (first && base > UINT64_MAX - member->size) {
+            fprintf(stderr, "Error: member %s is too large\n", member->name);
+            ret = -1;
+            break;
+        }
+        struct mzip_member *copy = directory_add(merged, member->name);
+        if (!copy) {
+            fprintf(stderr, "Error: cannot record member %s\n", member->name);
+            ret = -1;
+            break;
+        }
+        copy->size = member->size;
+        copy->chunks = member->chunks;
+        copy->base = base;
+        copy->flags = member->flags & ~MZIP_MEMBER_SEGMENT;
+        if (first) {
+            copy->flags |= MZIP_MEMBER_SEGMENT;
+            directory_find(merged, member->name)->total += member->size;
+        } else {
+            copy->total = member->size;
+        }
+
+        bool rewrite = copy->flags != member->flags || base != member->base;
+        if (!rewrite && member->offset == copy_end) {
+            copy->offset = pos + (copy_end - copy_start);
+            copy_end = member_end;
+            continue;
+        }
+
+        /* write out the pending run before starting a new one */
+        if (copy_range(in_fd, copy_start, out_fd, pos, copy_end - copy_start) <
+            0) {
+            fprintf(stderr, "Error: cannot copy chunks of %s\n", ifile);
+            ret = -1;
+            break;
+        }
+        pos += copy_end - copy_start;
+        copy->offset = pos;
+        copy_start = member->offset;
+
+        if (rewrite) {
+            uint16_t id, options;
+            uint32_t size, checksum, extra;
+            if (fseeko(in, member->offset, SEEK_SET) != 0 ||
+                !read_chunk_header(in, &id, &options, &size, &checksum,
+                                   &extra) ||
+                id != MZIP_FILEINFO_CHUNK_ID ||
+                size > member_end - member->offset - MZIP_CHUNK_HEADER_SIZE) {
+                fprintf(stderr, "Error: failed to read file info chunk of %s\n",
+                        member->name);
+                ret = -1;
+                break;
+            }
+            copy_start += MZIP_CHUNK_HEADER_SIZE + size;
+
+            if (fseeko(ofile, pos, SEEK_SET) != 0) {
+                ret = -1;
+                break;
+            }
+            write_fileinfo(ofile, copy);
+            if (fflush(ofile) != 0 || (pos = ftello(ofile)) < 0) {
+                ret = -1;
+                break;
+            }
+        }
+        copy_end = member_end;
+    }
+
+    if (ret == 0 &&
+        copy_range(in_fd, copy_start, out_fd, pos, copy_end - copy_start) < 0) {
+        fprintf(stderr, "Error: cannot copy chunks of %s\n", ifile);
+        ret = -1;
+    }
+    if (ret == 0 && fseeko(ofile, pos + (copy_end - copy_start), SEEK_SET) != 0)
+        ret = -1;
+
+    directory_free(&dir);
+    fclose(in);
+    return ret;
+}
+
+/* Merge archives without recompression: data and hole chunks are copied as
+ * they are and a new central directory is written.
+ */
+static int merge_archives(char **ifiles, int nfiles, const char *ofile)
+{
+    FILE *file = fopen(ofile, "rb");
+    if (file) {
+        printf("Error: file %s already exists. Aborted.\n\n", ofile);
+        fclose(file);
+        return -1;
+    }
+
+    file = fopen(ofile, "wb");
+    if (!file) {
+        printf("Error: could not create %s. Aborted.\n\n", ofile);
+        return -1;
+    }
+
+    struct mzip_directory dir = {0};
+    write_magic(file);
+    int ret = 0;
+    for (int i = 0; i < nfiles && ret == 0; i++)
+        ret = merge_archive(file, ifiles[i], &dir);
+    if (ret == 0)
+        ret = write_directory(file, &dir);
+
+    directory_free(&dir);
+    if (fclose(file) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+/* Tools provided by the mzip binary, selected by program name */
+enum mzip_mode {
+    MZIP_COMPRESS = 1,
+    MZIP_DECOMPRESS = 2,
+    MZIP_GREP = 4,
+};
+
+static const char *mode_name(enum mzip_mode mode)
+{
+    return mode == MZIP_COMPRESS ? "mzip"
+           : mode == MZIP_GREP   ? "mzgrep"
+                                 : "munzip";
+}
+
+static void show_usage(enum mzip_mode mode)
+{
+    if (mode == MZIP_COMPRESS) {
+        printf(
+            "mzip: small file compression tool\n"
+            "Usage: mzip [options] input-file... output-file\n"
+            "       mzip --merge archive... output-file\n"
+            "\n"
+            "Options:\n"
+            "  -a        append to an existing archive; stored members that\n"
+            "            have grown get only their new bytes added\n"
+            "  --verify  with -a, check all stored bytes of a grown member\n"
+            "            against the file, not only its last chunk\n"
+            "  -r        add the regular files below directory inputs\n"
+            "  -j N      compress with N threads (default: online CPUs)\n"
+            "  --merge   merge archives without recompressing their chunks\n"
+            "  --trace=json\n"
+            "            print per-chunk timings and a summary as JSON lines\n"
+            "\n");
+    } else if (mode == MZIP_DECOMPRESS) {
+        printf(
+            "munzip: uncompress mzip archive\n"
+            "Usage: munzip [options] archive-file [member...]\n"
+            "\n"
+            "Options:\n"
+            "  -l        list archive members\n"
+            "  -j N      extract with N threads (default: online CPUs)\n"
+            "  --trace=json\n"
+            "            print per-chunk timings and a summary as JSON lines\n"
+            "\n");
+    } else {
+        printf(
+            "mzgrep: search mzip archive members for a fixed string\n"
+            "Usage: mzgrep [options] pattern archive-file [member...]\n"
+            "\n"
+            "Prints member:offset for every occurrence.\n"
+            "\n"
+            "Options:\n"
+            "  -c        print the number of occurrences per member\n"
+            "  -l        print only the names of members with a match\n"
+            "  -q        print nothing, exit with 0 on the first match\n"
+            "  -j N      search with N threads (default: online CPUs)\n"
+            "\n");
+    }
+}
+
+/* Options besides -h/--help. Options with a value take it from the next
+ * argument, or from "--name=value" for long options.
+ */
+struct mzip_option {
+    const char *name;
+    bool has_value;
+    unsigned modes; /* modes accepting the option */
+};
+
+static const struct mzip_option mzip_options[] = {
+    {"-a", false, MZIP_COMPRESS},
+    {"-c", false, MZIP_GREP},
+    {"-l", false, MZIP_DECOMPRESS | MZIP_GREP},
+    {"-q", false, MZIP_GREP},
+    {"-r", false, MZIP_COMPRESS},
+    {"-j", true, MZIP_COMPRESS | MZIP_DECOMPRESS | MZIP_GREP},
+    {"--merge", false, MZIP_COMPRESS},
+    {"--verify", false, MZIP_COMPRESS},
+    {"--trace", true, MZIP_COMPRESS | MZIP_DECOMPRESS},
+};
+
+struct mzip_args {
+    char **files; /* non-option arguments, in order */
+    int nfiles;
+    bool append;
+    bool count;
+    bool list; /* mzgrep: only names of matching members */
+    bool merge;
+    bool quiet;
+    bool recursive;
+    bool trace;  /* --trace=json */
+    bool verify; /* -a: compare all stored bytes of grown members */
+    int jobs;    /* 0 = one per online CPU */
+};
+
+static int apply_option(struct mzip_args *args,
+                        const char *name,
+                        const char *value)
+{
+    if (!strcmp(name, "-a")) {
+        args->append = true;
+    } else if (!strcmp(name, "-c")) {
+        args->count = true;
+    } else if (!strcmp(name, "-q")) {
+        args->quiet = true;
+    } else if (!strcmp(name, "-l")) {
+        args->list = true;
+    } else if (!strcmp(name, "--merge")) {
+        args->merge = true;
+    } else if (!strcmp(name, "-r")) {
+        args->recursive = true;
+    } else if (!strcmp(name, "--verify")) {
+        args->verify = true;
+    } else if (!strcmp(name, "--trace")) {
+        if (strcmp(value, "json")) {
+            fprintf(stderr, "Error: unsupported trace format %s\n", value);
+            return -1;
+        }
+        args->trace = true;
+    } else if (!strcmp(name, "-j")) {
+        char *end;
+        long jobs = strtol(value, &end, 10);
+        if (*end || jobs < 1 || jobs > 1024) {
+            fprintf(stderr, "Error: invalid thread count %s\n", value);
+            return -1;
+        }
+        args->jobs = (int) jobs;
+    }
+    return 0;
+}
+
+static int handle_common_args(int argc,
+                              char **argv,
+                              enum mzip_mode mode,
+                              struct mzip_args *args)
+{
+    if (argc == 1) {
+        show_usage(mode);
+        return 0;
+    }
+
+    args->files = calloc(argc, sizeof(char *));
+    if (!args->files) {
+        fprintf(stderr, "Error: cannot allocate argument list\n");
+        return -1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (!arg)
+            continue;
+        if (arg[0] != '-') {
+            args->files[args->nfiles++] = arg;
+            continue;
+        }
+
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            show_usage(mode);
+            return 0;
+        }
+
+        const struct mzip_option *opt = NULL;
+        const char *value = NULL;
+        size_t n_options = sizeof(mzip_options) / sizeof(mzip_options[0]);
+        for (size_t k = 0; k < n_options && !opt; k++) {
+            const struct mzip_option *o = &mzip_options[k];
+            size_t len = strlen(o->name);
+            if (!(o->modes & mode) || strncmp(arg, o->name, len))
+                continue;
+            if (!arg[len])
+                opt = o;
+            else if (o->has_value && arg[1] == '-' && arg[len] == '=')
+                opt = o, value = arg + len + 1;
+        }
+
+        if (opt) {
+            if (opt->has_value && !value) {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "Error: option %s requires a value\n",
+                            arg);
+                    return -1;
+                }
+                value = argv[++i];
+            }
+            if (apply_option(args, opt->name, value) < 0)
+                return -1;
+            continue;
+        }
+
+        printf(
+            "Error: unknown option %s\n\n"
+            "To get help on usage:\n"
+            "  %s --help\n\n",
+            arg, mode_name(mode));
+        return -1;
+    }
+
+    return 1; /* Continue processing */
+}
+
+static int compress(int argc, char **argv)
+{
+    struct mzip_args args = {0};
+
+    /* Handle common arguments (-h, --help, -v, --version, unknown options) */
+    int result = handle_common_args(argc, argv, MZIP_COMPRESS, &args);
+    if (result <= 0) {
+        free(args.files);
+        return result; /* 0 = help/version shown, -1 = error */
+    }
+
+    /* All but the last file are inputs, the last one is the archive */
+    if (args.nfiles < 2) {
+        fprintf(stderr, "Error: missing input or output file\n\n");
+        show_usage(MZIP_COMPRESS);
+        free(args.files);
+        return -1;
+    }
+
+    if (args.merge && (args.append || args.trace)) {
+        fprintf(stderr, "Error: --merge cannot be combined with %s\n",
+                args.append ? "-a" : "--trace");
+        result = -1;
+    } else if (args.verify && !args.append) {
+        fprintf(stderr, "Error: --verify requires -a\n");
+        result = -1;
+    } else if (args.merge) {
+        result = merge_archives(args.files, args.nfiles - 1,
+                                args.files[args.nfiles - 1]);
+    } else {
+        result = pack_file(args.files, args.nfiles - 1,
+                           args.files[args.nfiles - 1], args.recursive,
+                           args.append, args.verify, args.jobs, args.trace);
+    }
+    free(args.files);
+    return result;
+}
+
+static int list_archive(const char *ifile)
+{
+    struct mzip_directory dir = {0};
+    uint64_t fsize;
+    FILE *in = open_archive(ifile, &fsize, &dir, NULL);
+    if (!in)
+        return -1;
+
+    uint64_t total_size = 0, total_chunks = 0;
+    size_t files = 0;
+    printf("%14s %8s  %s\n", "Length", "Chunks", "Name");
+    printf("%14s %8s  %s\n", "------", "------", "----");
+    for (size_t i = 0; i < dir.count; i++) {
+        const struct mzip_member *member = &dir.members[i];
+        bool segment = member->flags & MZIP_MEMBER_SEGMENT;
+        printf("%14llu %8u  %s%s\n", (unsigned long long) member->size,
+               member->chunks, member->name, segment ? " (appended)" : "");
+        total_size += member->size;
+        total_chunks += member->chunks;
+        files += !segment;
+    }
+    printf("%14s %8s\n", "------", "------");
+    printf("%14llu %8llu  %zu file(s)\n", (unsigned long long) total_size,
+           (unsigned long long) total_chunks, files);
+
+    directory_free(&dir);
+    fclose(in);
+    return 0;
+}
+
+/* Per-thread decompression buffers, grown on demand */
+struct unpack_buffers {
+    uint8_t *compressed, *decompressed;
+    size_t compressed_size, decompressed_size;
+};
+
+static bool reserve_buffer(uint8_t **buffer, size_t *capacity, size_t size)
+{
+    if (size <= *capacity)
+        return true;
+    uint8_t *tmp = realloc(*buffer, size);
+    if (!tmp)
+        return false;
+    *buffer = tmp;
+    *capacity = size;
+    return true;
+}
+
+/* Create the missing parent directories of a validated member path. Existing
+ * components must be real directories, not symlinks that could redirect the
+ * extraction outside the current directory.
+ */
+static int create_parent_dirs(const char *name)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s", name);
+
+    for (char *p = strchr(path, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        struct stat st;
+        if (mkdir(path, 0755) != 0 &&
+            (lstat(path, &st) != 0 || !S_ISDIR(st.st_mode))) {
+            fprintf(stderr, "Error: cannot create directory %s\n", path);
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+/* Members of at least this size are preallocated and, when that succeeds,
+ * mapped so that chunks decompress straight into the output file. Smaller
+ * members (and file systems without fallocate) are written with pwrite().
+ */
+#define MIN_MAPPED_SIZE (8 * BLOCK_SIZE)
+
+/* Output file of a member being extracted */
+struct unpack_output {
+    const struct mzip_member *member;
+    int fd;
+    uint8_t *map; /* whole-file mapping, or NULL to use pwrite() */
+    size_t pending; /* chunks in flight plus one reference for the producer */
+};
+
+/* Data chunk to decompress to its final offset in the output file */
+struct unpack_chunk {
+    struct unpack_output *output;
+    uint64_t pos; /* archive offset of the compressed payload */
+    uint64_t out_offset;
+    uint32_t size, raw_size, checksum;
+};
+
+/* Chunks are queued by the main thread in archive order and decompressed by
+ * the workers in any order, each writing to its own output range.
+ */
+struct unpack_job {
+    const char *archive;
+    uint64_t fsize;
+    int archive_fd;
+    struct unpack_chunk *queue; /* ring buffer */
+    size_t head, count, capacity;
+    bool closed;
+    int status;
+    struct mzip_trace trace; /* updated under lock */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+};
+
+static void unpack_fail(struct unpack_job *job)
+{
+    pthread_mutex_lock(&job->lock);
+    job->status = -1;
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* Drop one reference to an output; the last one closes the file */
+static void output_release(struct unpack_job *job,
+                           struct unpack_output *output,
+                           int status)
+{
+    pthread_mutex_lock(&job->lock);
+    if (status < 0)
+        job->status = -1;
+    bool last = --output->pending == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (!last)
+        return;
+
+    bool unmapped =
+        !output->map || munmap(output->map, output->member->size) == 0;
+    if (close(output->fd) != 0 || !unmapped) {
+        fprintf(stderr, "Error: cannot write %s\n", output->member->name);
+        unpack_fail(job);
+    }
+    free(output);
+}
+
+static int unpack_chunk(struct unpack_job *job,
+                        const struct unpack_chunk *chunk,
+                        struct unpack_buffers *bufs)
+{
+    const char *name = chunk->output->member->name;
+
+    if (!reserve_buffer(&bufs->compressed, &bufs->compressed_size,
+                        chunk->size) ||
+        (!chunk->output->map &&
+         !reserve_buffer(&bufs->decompressed, &bufs->decompressed_size,
+                         chunk->raw_size))) {
+        fprintf(stderr, "Error: cannot allocate chunk buffers\n");
+        return -1;
+    }
+
+    /* read and check checksum */
+    uint64_t start = now_ns();
+    if (pread(job->archive_fd, bufs->compressed, chunk->size, chunk->pos) !=
+        (ssize_t) chunk->size) {
+        fprintf(stderr, "Error: cannot read compressed chunk\n");
+        return -1;
+    }
+    uint64_t read_done = now_ns();
+    MZIP_PROBE3(chunk__read, chunk->pos, chunk->size, read_done - start);
+    uint32_t checksum = update_adler32(1L, bufs->compressed, chunk->size);
+    uint64_t checksum_done = now_ns();
+
+    /* verify that the chunk data is correct */
+    if (checksum != chunk->checksum) {
+        fprintf(stderr, "\nError: checksum mismatch. Skipped.\n");
+        fprintf(stderr, "Got %08X Expecting %08X\n", checksum,
+                chunk->checksum);
+        return -1;
+    }
+
+    /* decompress in place when mapped, otherwise through a buffer */
+    uint8_t *dest = chunk->output->map
+                        ? chunk->output->map + chunk->out_offset
+                        : bufs->decompressed;
+    uint32_t remaining = lz77_decompress(bufs->compressed, chunk->size, dest,
+                                         chunk->raw_size);
+    uint64_t decompress_done = now_ns();
+    if (remaining != chunk->raw_size) {
+        fprintf(stderr, "\nError: decompression failed. Skipped.\n");
+        return -1;
+    }
+
+    for (size_t done = 0; !chunk->output->map && done < chunk->raw_size;) {
+        ssize_t n = pwrite(chunk->output->fd, dest + done,
+                           chunk->raw_size - done, chunk->out_offset + done);
+        if (n <= 0) {
+            fprintf(stderr, "Error: cannot write %s\n", name);
+            return -1;
+        }
+        done += n;
+    }
+    uint64_t write_done = now_ns();
+    MZIP_PROBE3(chunk__write, chunk->out_offset, chunk->raw_size,
+                write_done - decompress_done);
+
+    if (job->trace.enabled) {
+        uint64_t io = read_done - start + write_done - decompress_done;
+        pthread_mutex_lock(&job->lock);
+        trace_chunk(&job->trace, name, chunk->out_offset, chunk->raw_size,
+                    chunk->size, false, decompress_done - checksum_done,
+                    checksum_done - read_done, io);
+        pthread_mutex_unlock(&job->lock);
+    }
+    return 0;
+}
+
+static void *unpack_worker(void *arg)
+{
+    struct unpack_job *job = arg;
+    struct unpack_buffers bufs = {0};
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        while (!job->count && !job->closed)
+            pthread_cond_wait(&job->not_empty, &job->lock);
+        if (!job->count) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        struct unpack_chunk chunk = job->queue[job->head];
+        job->head = (job->head + 1) % job->capacity;
+        job->count--;
+        /* skip the remaining work after the first failure */
+        bool failed = job->status < 0;
+        pthread_cond_signal(&job->not_full);
+        pthread_mutex_unlock(&job->lock);
+
+        int status = failed ? 0 : unpack_chunk(job, &chunk, &bufs);
+        output_release(job, chunk.output, status);
+    }
+
+    free(bufs.compressed);
+    free(bufs.decompressed);
+    return NULL;
+}
+
+static void unpack_push(struct unpack_job *job,
+                        const struct unpack_chunk *chunk)
+{
+    pthread_mutex_lock(&job->lock);
+    while (job->count == job->capacity)
+        pthread_cond_wait(&job->not_full, &job->lock);
+    job->queue[(job->head + job->count) % job->capacity] = *chunk;
+    job->count++;
+    chunk->output->pending++;
+    pthread_cond_signal(&job->not_empty);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* Allocate disk space for a range of the output file */
+static bool preallocate(int fd, uint64_t offset, uint64_t length)
+{
+    if (!length)
+        return true;
+#if defined(__linux__)
+    return fallocate(fd, 0, offset, length) == 0;
+#else
+    (void) fd, (void) offset;
+    return false;
+#endif
+}
+
+/* Walk the data and hole chunks following a member's file info chunk. The
+ * first pass (output == NULL) validates the chunk headers and preallocates
+ * the data ranges of fd; the second pass queues the data chunks.
+ */
+static int walk_member_chunks(struct unpack_job *job,
+                              FILE *in,
+                              const struct mzip_member *member,
+                              uint64_t pos,
+                              int fd,
+                              bool *preallocated,
+                              struct unpack_output *output)
+{
+    uint64_t out_offset = 0, range_start = 0;
+    uint32_t chunks = 0;
+
+    while (pos < job->fsize && chunks < member->chunks) {
+        struct member_chunk mc;
+        int found = read_member_chunk(in, job->fsize, member, &pos,
+                                      member->size - out_offset, &mc);
+        if (found < 0)
+            return -1;
+        if (!found)
+            break;
+
+        if (mc.hole) {
+            /* holes are left unwritten in the preallocated-size file;
+             * preallocate the data range ending at the hole
+             */
+            if (!output && *preallocated)
+                *preallocated =
+                    preallocate(fd, range_start, out_offset - range_start);
+            range_start = out_offset + mc.length;
+            if (output && job->trace.enabled) {
+                pthread_mutex_lock(&job->lock);
+                trace_chunk(&job->trace, member->name,
+                            member->base + out_offset, mc.length, 0, true, 0,
+                            0, 0);
+                pthread_mutex_unlock(&job->lock);
+            }
+        } else if (output) {
+            struct unpack_chunk chunk = {
+                .output = output,
+                .pos = mc.pos,
+                .out_offset = member->base + out_offset,
+                .size = mc.size,
+                .raw_size = mc.length,
+                .checksum = mc.checksum,
+            };
+            unpack_push(job, &chunk);
+        }
+
+        out_offset += mc.length;
+        chunks++;
+    }
+
+    if (out_offset != member->size || chunks != member->chunks) {
+        fprintf(stderr, "Error: %s is truncated (%llu of %llu bytes)\n",
+                member->name, (unsigned long long) out_offset,
+                (unsigned long long) member->size);
+        return -1;
+    }
+    if (!output && *preallocated)
+        *preallocated = preallocate(fd, range_start, out_offset - range_start);
+    return 0;
+}
+
+/* Create a member's output file and queue its data chunks */
+static int unpack_member(struct unpack_job *job,
+                         FILE *in,
+                         const struct mzip_member *member,
+                         struct unpack_buffers *bufs)
+{
+    uint16_t chunk_id, chunk_options;
+    uint32_t chunk_size, chunk_checksum, chunk_extra;
+
+    if (fseeko(in, member->offset, SEEK_SET) != 0 ||
+        !read_chunk_header(in, &chunk_id, &chunk_options, &chunk_size,
+                           &chunk_checksum, &chunk_extra) ||
+        chunk_id != MZIP_FILEINFO_CHUNK_ID || chunk_size <= 10 ||
+        chunk_size >= BLOCK_SIZE ||
+        !reserve_buffer(&bufs->compressed, &bufs->compressed_size,
+                        chunk_size) ||
+        fread(bufs->compressed, 1, chunk_size, in) != chunk_size) {
+        fprintf(stderr, "Error: failed to read file info chunk of %s\n",
+                member->name);
+        return -1;
+    }
+
+    uint32_t checksum = update_adler32(1L, bufs->compressed, chunk_size);
+    if (checksum != chunk_checksum) {
+        fprintf(stderr, "\nError: checksum mismatch!\n");
+        fprintf(stderr, "Got %08X Expecting %08X\n", checksum, chunk_checksum);
+        return -1;
+    }
+
+    /* the file info chunk must agree with the directory entry */
+    size_t fname_len = strlen(member->name) + 1;
+    bool segment = member->flags & MZIP_MEMBER_SEGMENT;
+    const uint8_t *base =
+        bufs->compressed + MZIP_FILEINFO_FIXED_SIZE + fname_len;
+    if (read_u64(bufs->compressed) != member->size ||
+        fname_len > chunk_size - MZIP_FILEINFO_FIXED_SIZE ||
+        memcmp(bufs->compressed + MZIP_FILEINFO_FIXED_SIZE, member->name,
+               fname_len) ||
+        segment != !!(chunk_options & MZIP_FILEINFO_SEGMENT) ||
+        (segment && (chunk_size != MZIP_FILEINFO_FIXED_SIZE + fname_len + 8 ||
+                     read_u64(base) != member->base))) {
+        fprintf(stderr, "Error: file info of %s does not match directory\n",
+                member->name);
+        return -1;
+    }
+
+    /* Validate filename for security (prevent path traversal) */
+    const char *ofile_name = member->name;
+    if (!is_safe_filename(ofile_name)) {
+        fprintf(stderr,
+                "Error: unsafe filename '%s' rejected (potential path "
+                "traversal attack)\n",
+                ofile_name);
+        return -1;
+    }
+    if (create_parent_dirs(ofile_name) < 0)
+        return -1;
+
+    /* Create file exclusively (fails if already exists). Segments extend
+     * the file created for the first entry of their name, which precedes
+     * them in archive order.
+     */
+    int fd = segment ? open(ofile_name, O_RDWR | O_NOFOLLOW)
+                     : open(ofile_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr,
+                "File %s already exists or cannot be created. Skipped.\n",
+                ofile_name);
+        return -1;
+    }
+
+    /* size the file up front; holes stay unallocated. Segments are written
+     * with pwrite() since their range does not start at offset 0.
+     */
+    uint64_t first_chunk = member->offset + MZIP_CHUNK_HEADER_SIZE + chunk_size;
+    bool preallocated = !segment && member->size >= MIN_MAPPED_SIZE &&
+                        member->size <= SIZE_MAX;
+    if (ftruncate(fd, member->base + member->size) != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", ofile_name);
+        close(fd);
+        return -1;
+    }
+    if (walk_member_chunks(job, in, member, first_chunk, fd, &preallocated,
+                           NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct unpack_output *output = calloc(1, sizeof(*output));
+    if (!output) {
+        fprintf(stderr, "Error: cannot allocate output state\n");
+        close(fd);
+        return -1;
+    }
+    output->member = member;
+    output->fd = fd;
+    output->pending = 1;
+
+    /* mapping is only safe once every data range is allocated: a write
+     * fault on a full disk would raise SIGBUS instead of an error
+     */
+    if (preallocated) {
+        void *map = mmap(NULL, member->size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED)
+            output->map = map;
+    }
+
+    int status = walk_member_chunks(job, in, member, first_chunk, fd, NULL,
+                                    output);
+    output_release(job, output, status);
+    return status;
+}
+
+static int unpack_file(const char *ifile,
+                       char **names,
+                       int nnames,
+                       int jobs,
+                       bool trace)
+{
+    struct mzip_directory dir = {0};
+    uint64_t fsize;
+    FILE *in = open_archive(ifile, &fsize, &dir, NULL);
+    if (!in)
+        return -1;
+
+    const struct mzip_member **members =
+        calloc(dir.count ? dir.count : 1, sizeof(*members));
+    if (!members) {
+        fprintf(stderr, "Error: cannot allocate member list\n");
+        directory_free(&dir);
+        fclose(in);
+        return -1;
+    }
+
+    /* select the requested members, or all of them */
+    int status = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < dir.count; i++) {
+        if (nnames == 0)
+            members[count++] = &dir.members[i];
+    }
+    for (int k = 0; k < nnames && count < dir.count; k++) {
+        const struct mzip_member *member = directory_find(&dir, names[k]);
+        if (!member) {
+            fprintf(stderr, "Error: member %s not found in %s\n", names[k],
+                    ifile);
+            status = -1;
+            continue;
+        }
+        /* a member's appended segments follow it in archive order */
+        for (size_t i = member - dir.members; i < dir.count; i++) {
+            if (!strcmp(dir.members[i].name, names[k]) && count < dir.count)
+                members[count++] = &dir.members[i];
+        }
+    }
+
+    if (jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (int) cpus : 1;
+    }
+
+    struct unpack_job job = {
+        .archive = ifile,
+        .fsize = fsize,
+        .archive_fd = fileno(in),
+        .capacity = (size_t) jobs * 16,
+        .status = status,
+        .trace.enabled = trace,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .not_empty = PTHREAD_COND_INITIALIZER,
+        .not_full = PTHREAD_COND_INITIALIZER,
+    };
+    trace_start(&job.trace, false);
+    job.queue = calloc(job.capacity, sizeof(*job.queue));
+    if (!job.queue) {
+        fprintf(stderr, "Error: cannot allocate chunk queue\n");
+        job.status = -1;
+    }
+
+    pthread_t threads[jobs];
+    int started = 0;
+    for (int t = 0; t < jobs && job.status == 0; t++) {
+        if (pthread_create(&threads[started], NULL, unpack_worker, &job))
+            break;
+        started++;
+    }
+    if (job.status == 0 && !started) {
+        fprintf(stderr, "Error: cannot start extraction threads\n");
+        job.status = -1;
+    }
+
+    /* the main thread prepares members and feeds their chunks to workers */
+    struct unpack_buffers bufs = {0};
+    for (size_t i = 0; i < count; i++) {
+        pthread_mutex_lock(&job.lock);
+        bool failed = job.status < 0;
+        pthread_mutex_unlock(&job.lock);
+        /* stop preparing members after the first failure */
+        if (failed || unpack_member(&job, in, members[i], &bufs) < 0) {
+            unpack_fail(&job);
+            break;
+        }
+    }
+    free(bufs.compressed);
+    free(bufs.decompressed);
+
+    pthread_mutex_lock(&job.lock);
+    job.closed = true;
+    pthread_cond_broadcast(&job.not_empty);
+    pthread_mutex_unlock(&job.lock);
+    for (int t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+
+    status = job.status;
+    if (trace)
+        trace_summary(&job.trace, jobs, status);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.not_empty);
+    pthread_cond_destroy(&job.not_full);
+    free(job.queue);
+    free(members);
+    directory_free(&dir);
+    fclose(in);
+    return status;
+}
+
+/* mzgrep: worker threads decompress and search chunks in any order, the main
+ * thread reports their occurrences in file order. Occurrences spanning two
+ * chunks are found by the main thread from the last pattern length - 1 bytes
+ * of the stream so far (the carry) and the first bytes of the next chunk.
+ */
+struct grep_task {
+    size_t file; /* directory index of the file's first entry, or SIZE_MAX */
+    struct member_chunk chunk;
+    uint64_t out_offset;
+    /* results */
+    uint64_t *hits; /* offsets in the chunk, ascending */
+    size_t nhits, hits_capacity;
+    uint8_t *head, *tail; /* first and last edge_len bytes of the chunk */
+    uint32_t edge_len;
+    bool done;
+    int status;
+};
+
+struct grep_job {
+    int archive_fd;
+    const uint8_t *pattern;
+    size_t pattern_len;
+    bool first_only; /* -l and -q need only a file's first occurrence */
+    struct grep_task *tasks; /* ring of in-flight tasks */
+    size_t capacity, submitted, taken, collected;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+};
+
+/* Reporting state of the main thread */
+struct grep_state {
+    const struct mzip_directory *dir;
+    const struct mzip_args *args;
+    uint8_t *carry, *window; /* pattern_len - 1 and 2 * that bytes */
+    size_t carry_len;
+    uint64_t file_hits;
+    bool matched; /* any occurrence so far */
+    bool stop;    /* -q: nothing more to find */
+    int status;
+};
+
+static bool grep_add_hit(struct grep_task *task, uint64_t offset)
+{
+    if (task->nhits == task->hits_capacity) {
+        size_t capacity = task->hits_capacity ? task->hits_capacity * 2 : 16;
+        uint64_t *hits = realloc(task->hits, capacity * sizeof(*hits));
+        if (!hits)
+            return false;
+        task->hits = hits;
+        task->hits_capacity = capacity;
+    }
+    task->hits[task->nhits++] = offset;
+    return true;
+}
+
+/* Search starts in [from, to) of a decompressed chunk; stops at the first
+ * occurrence when first_only is set.
+ */
+static bool grep_range(struct grep_job *job,
+                       struct grep_task *task,
+                       const uint8_t *out,
+                       uint64_t out_len,
+                       uint64_t from,
+                       uint64_t to)
+{
+    size_t m = job->pattern_len;
+    uint64_t end = to + m - 1 < out_len ? to + m - 1 : out_len;
+
+    while (from + m <= end) {
+        const uint8_t *p = memmem(out + from, end - from, job->pattern, m);
+        if (!p)
+            break;
+        if (!grep_add_hit(task, p - out))
+            return false;
+        if (job->first_only)
+            break;
+        from = p - out + 1;
+    }
+    return true;
+}
+
+/* Find the first occurrence in a chunk with the help of its token stream. An
+ * occurrence lying within the output of one match token repeats an earlier
+ * one, so starts inside long match copies are never tried: on repetitive
+ * data only the literals and the token edges are searched.
+ */
+static bool grep_first(struct grep_job *job,
+                       struct grep_task *task,
+                       const uint8_t *in,
+                       uint32_t length,
+                       const uint8_t *out,
+                       uint64_t out_len)
+{
+    const uint8_t *ip = in, *ip_bound = length >= 2 ? in + length - 2 : in;
+    uint64_t op = 0, from = 0;
+    uint32_t ctrl = *ip++ & 31;
+
+    /* the chunk was decompressed already, so its tokens are well-formed */
+    while (1) {
+        if (ctrl >= 32) {
+            uint32_t len = (ctrl >> 5) - 1;
+            if (len == 6)
+                len += *ip++;
+            ip++;
+            len += 3;
+            if (len >= job->pattern_len) {
+                if (from < op && !grep_range(job, task, out, out_len, from, op))
+                    return false;
+                if (task->nhits)
+                    return true;
+                from = op + len - job->pattern_len + 1 > from
+                           ? op + len - job->pattern_len + 1
+                           : from;
+            }
+            op += len;
+        } else {
+            ctrl++;
+            ip += ctrl, op += ctrl;
+        }
+
+        if (ip > ip_bound)
+            break;
+        ctrl = *ip++;
+    }
+
+    return grep_range(job, task, out, out_len, from, out_len);
+}
+
+static int grep_chunk(struct grep_job *job,
+                      struct grep_task *task,
+                      struct unpack_buffers *bufs)
+{
+    const struct member_chunk *chunk = &task->chunk;
+    if (!reserve_buffer(&bufs->compressed, &bufs->compressed_size,
+                        chunk->size) ||
+        !reserve_buffer(&bufs->decompressed, &bufs->decompressed_size,
+                        chunk->length)) {
+        fprintf(stderr, "Error: cannot allocate chunk buffers\n");
+        return -1;
+    }
+
+    if (pread(job->archive_fd, bufs->compressed, chunk->size, chunk->pos) !=
+        (ssize_t) chunk->size) {
+        fprintf(stderr, "Error: cannot read compressed chunk\n");
+        return -1;
+    }
+    uint32_t checksum = update_adler32(1L, bufs->compressed, chunk->size);
+    if (checksum != chunk->checksum) {
+        fprintf(stderr, "\nError: checksum mismatch. Skipped.\n");
+        fprintf(stderr, "Got %08X Expecting %08X\n", checksum,
+                chunk->checksum);
+        return -1;
+    }
+
+    const uint8_t *out = bufs->decompressed;
+    uint32_t out_len = chunk->length;
+    if (lz77_decompress(bufs->compressed, chunk->size, bufs->decompressed,
+                        out_len) != (int) out_len) {
+        fprintf(stderr, "\nError: decompression failed. Skipped.\n");
+        return -1;
+    }
+
+    bool ok = job->first_only
+                  ? grep_first(job, task, bufs->compressed, chunk->size, out,
+                               out_len)
+                  : grep_range(job, task, out, out_len, 0, out_len);
+    if (!ok) {
+        fprintf(stderr, "Error: cannot allocate search results\n");
+        return -1;
+    }
+
+    size_t edge = job->pattern_len - 1;
+    task->edge_len = out_len < edge ? out_len : edge;
+    memcpy(task->head, out, task->edge_len);
+    memcpy(task->tail, out + out_len - task->edge_len, task->edge_len);
+    return 0;
+}
+
+static void *grep_worker(void *arg)
+{
+    struct grep_job *job = arg;
+    struct unpack_buffers bufs = {0};
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        while (job->taken == job->submitted && !job->closed)
+            pthread_cond_wait(&job->work, &job->lock);
+        if (job->taken == job->submitted) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        struct grep_task *task = &job->tasks[job->taken++ % job->capacity];
+        pthread_mutex_unlock(&job->lock);
+
+        int status = task->chunk.hole ? 0 : grep_chunk(job, task, &bufs);
+
+        pthread_mutex_lock(&job->lock);
+        task->status = status;
+        task->done = true;
+        pthread_cond_broadcast(&job->done);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    free(bufs.compressed);
+    free(bufs.decompressed);
+    return NULL;
+}
+
+static void grep_report(struct grep_state *state,
+                        const struct mzip_member *file,
+                        uint64_t offset)
+{
+    state->matched = true;
+    if (state->args->quiet) {
+        state->stop = true;
+    } else if (state->args->list) {
+        if (!state->file_hits)
+            printf("%s\n", file->name);
+    } else if (!state->args->count) {
+        printf("%s:%llu\n", file->name, (unsigned long long) offset);
+    }
+    state->file_hits++;
+}
+
+/* Report the occurrences of the oldest task, in file order */
+static void grep_collect(struct grep_job *job, struct grep_state *state)
+{
+    struct grep_task *task = &job->tasks[job->collected % job->capacity];
+
+    pthread_mutex_lock(&job->lock);
+    while (!task->done)
+        pthread_cond_wait(&job->done, &job->lock);
+    pthread_mutex_unlock(&job->lock);
+
+    size_t m = job->pattern_len;
+    const struct mzip_member *file = &state->dir->members[task->file];
+    bool skip = state->stop || (job->first_only && state->file_hits);
+
+    if (task->status < 0) {
+        state->status = -1;
+    } else if (task->chunk.hole) {
+        /* patterns hold no NUL bytes, so nothing spans a hole */
+        state->carry_len = 0;
+    } else if (!skip) {
+        /* occurrences starting in the carry and ending in this chunk */
+        uint8_t *w = state->window;
+        size_t n = state->carry_len + task->edge_len;
+        memcpy(w, state->carry, state->carry_len);
+        memcpy(w + state->carry_len, task->head, task->edge_len);
+        for (size_t p = 0; p < state->carry_len && p + m <= n; p++) {
+            if (!memcmp(w + p, job->pattern, m))
+                grep_report(state, file,
+                            task->out_offset - state->carry_len + p);
+        }
+        for (size_t i = 0; i < task->nhits; i++)
+            grep_report(state, file, task->out_offset + task->hits[i]);
+
+        /* the carry becomes the last m - 1 bytes of the stream */
+        if (task->edge_len == m - 1) {
+            memcpy(state->carry, task->tail, task->edge_len);
+            state->carry_len = task->edge_len;
+        } else {
+            size_t keep = n < m - 1 ? n : m - 1;
+            memcpy(state->carry, w + n - keep, keep);
+            state->carry_len = keep;
+        }
+    }
+
+    task->done = false;
+    task->nhits = 0;
+    job->collected++;
+}
+
+static void grep_submit(struct grep_job *job,
+                        struct grep_state *state,
+                        size_t file,
+                        const struct member_chunk *chunk,
+                        uint64_t out_offset)
+{
+    while (job->submitted - job->collected == job->capacity)
+        grep_collect(job, state);
+
+    pthread_mutex_lock(&job->lock);
+    struct grep_task *task = &job->tasks[job->submitted % job->capacity];
+    task->file = file;
+    task->chunk = *chunk;
+    task->out_offset = out_offset;
+    task->status = 0;
+    job->submitted++;
+    pthread_cond_signal(&job->work);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/* Queue the chunks of one archive entry (a file or an appended segment) */
+static int grep_entry(struct grep_job *job,
+                      struct grep_state *state,
+                      FILE *in,
+                      uint64_t fsize,
+                      size_t file,
+                      const struct mzip_member *member)
+{
+    uint16_t id, options;
+    uint32_t size, checksum, extra;
+    if (fseeko(in, member->offset, SEEK_SET) != 0 ||
+        !read_chunk_header(in, &id, &options, &size, &checksum, &extra) ||
+        id != MZIP_FILEINFO_CHUNK_ID || size >= BLOCK_SIZE) {
+        fprintf(stderr, "Error: failed to read file info chunk of %s\n",
+                member->name);
+        return -1;
+    }
+
+    uint64_t pos = member->offset + MZIP_CHUNK_HEADER_SIZE + size;
+    uint64_t out_offset = 0;
+    uint32_t chunks = 0;
+    while (pos < fsize && chunks < member->chunks) {
+        /* -l and -q are done with a file at its first occurrence */
+        if (state->stop || state->status < 0 ||
+            (job->first_only && state->file_hits))
+            return 0;
+
+        struct member_chunk chunk;
+        int found = read_member_chunk(in, fsize, member, &pos,
+                                      member->size - out_offset, &chunk);
+        if (found < 0)
+            return -1;
+        if (!found)
+            break;
+        grep_submit(job, state, file, &chunk, member->base + out_offset);
+        out_offset += chunk.length;
+        chunks++;
+    }
+
+    if (out_offset != member->size || chunks != member->chunks) {
+        fprintf(stderr, "Error: %s is truncated (%llu of %llu bytes)\n",
+                member->name, (unsigned long long) out_offset,
+                (unsigned long long) member->size);
+        return -1;
+    }
+    return 0;
+}
+
+static int grep_archive(const char *pattern,
+                        const char *ifile,
+                        char **names,
+                        int nnames,
+                        const struct mzip_args *args)
+{
+    struct mzip_directory dir = {0};
+    uint64_t fsize;
+    FILE *in = open_archive(ifile, &fsize, &dir, NULL);
+    if (!in)
+        return -1;
+
+    int jobs = args->jobs;
+    if (jobs <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (int) cpus : 1;
+    }
+
+    size_t m = strlen(pattern);
+    struct grep_job job = {
+        .archive_fd = fileno(in),
+        .pattern = (const uint8_t *) pattern,
+        .pattern_len = m,
+        .first_only = args->list || args->quiet,
+        .capacity = (size_t) jobs * 16,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .work = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+    };
+    struct grep_state state = {.dir = &dir, .args = args};
+
+    /* chain each file's appended segments: next[i] follows entry i */
+    size_t *next = malloc((dir.count ? dir.count : 1) * sizeof(*next));
+    size_t *last = malloc((dir.count ? dir.count : 1) * sizeof(*last));
+    job.tasks = calloc(job.capacity, sizeof(*job.tasks));
+    state.carry = malloc(m);
+    state.window = malloc(2 * m);
+    bool ok = next && last && job.tasks && state.carry && state.window;
+    for (size_t i = 0; ok && i < job.capacity; i++) {
+        job.tasks[i].head = malloc(m);
+        job.tasks[i].tail = malloc(m);
+        ok = job.tasks[i].head && job.tasks[i].tail;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: cannot allocate search state\n");
+        state.status = -1;
+    }
+    for (size_t i = 0; ok && i < dir.count; i++) {
+        next[i] = SIZE_MAX;
+        last[i] = i;
+        if (dir.members[i].flags & MZIP_MEMBER_SEGMENT) {
+            size_t first =
+                directory_find(&dir, dir.members[i].name) - dir.members;
+            next[last[first]] = i;
+            last[first] = i;
+        }
+    }
+
+    for (int k = 0; k < nnames; k++) {
+        if (!directory_find(&dir, names[k])) {
+            fprintf(stderr, "Error: member %s not found in %s\n", names[k],
+                    ifile);
+            state.status = -1;
+        }
+    }
+
+    pthread_t threads[jobs];
+    int started = 0;
+    for (int t = 0; t < jobs && state.status == 0; t++) {
+        if (pthread_create(&threads[started], NULL, grep_worker, &job))
+            break;
+        started++;
+    }
+    if (state.status == 0 && !started) {
+        fprintf(stderr, "Error: cannot start search threads\n");
+        state.status = -1;
+    }
+
+    for (size_t i = 0; i < dir.count && state.status == 0 && !state.stop;
+         i++) {
+        const struct mzip_member *file = &dir.members[i];
+        bool selected = nnames == 0;
+        for (int k = 0; k < nnames && !selected; k++)
+            selected = !strcmp(names[k], file->name);
+        if (!selected || (file->flags & MZIP_MEMBER_SEGMENT))
+            continue;
+
+        for (size_t e = i; e != SIZE_MAX && state.status == 0; e = next[e]) {
+            if (grep_entry(&job, &state, in, fsize, i, &dir.members[e]) < 0)
+                state.status = -1;
+        }
+
+        /* report the file once its chunks are collected */
+        while (job.collected < job.submitted)
+            grep_collect(&job, &state);
+        if (state.status == 0 && args->count && !args->list && !args->quiet)
+            printf("%s:%llu\n", file->name,
+                   (unsigned long long) state.file_hits);
+        state.file_hits = 0;
+        state.carry_len = 0;
+    }
+
+    /* drain tasks still in flight after an error */
+    while (job.collected < job.submitted)
+        grep_collect(&job, &state);
+    pthread_mutex_lock(&job.lock);
+    job.closed = true;
+    pthread_cond_broadcast(&job.work);
+    pthread_mutex_unlock(&job.lock);
+    for (int t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+
+    for (size_t i = 0; job.tasks && i < job.capacity; i++) {
+        free(job.tasks[i].hits);
+        free(job.tasks[i].head);
+        free(job.tasks[i].tail);
+    }
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.work);
+    pthread_cond_destroy(&job.done);
+    free(job.tasks);
+    free(state.carry);
+    free(state.window);
+    free(next);
+    free(last);
+    directory_free(&dir);
+    fclose(in);
+
+    if (state.status < 0)
+        return -1;
+    return state.matched ? 0 : 1;
+}
+
+static int decompress(int argc, char **argv)
+{
+    struct mzip_args args = {0};
+
+    /* Handle common arguments (-h, --help, -v, --version, unknown options) */
+    int result = handle_common_args(argc, argv, MZIP_DECOMPRESS, &args);
+    if (result <= 0) {
+        free(args.files);
+        return result; /* 0 = help/version shown, -1 = error */
+    }
 
     /* needs at least one non-option argument (archive file) */
-    if (argc <= 1) {
-        show_usage(false);
+    if (args.nfiles < 1) {
+        show_usage(MZIP_DECOMPRESS);
+        free(args.files);
         return 0;
     }
 
-    return unpack_file(argv[1]);
+    if (args.list)
+        result = list_archive(args.files[0]);
+    else
+        result = unpack_file(args.files[0], args.files + 1, args.nfiles - 1,
+                             args.jobs, args.trace);
+    free(args.files);
+    return result;
+}
+
+/* mzgrep exits with 0 when the pattern was found, 1 when it was not and 2 on
+ * errors, like grep.
+ */
+static int grep(int argc, char **argv)
+{
+    struct mzip_args args = {0};
+
+    int result = handle_common_args(argc, argv, MZIP_GREP, &args);
+    if (result <= 0) {
+        free(args.files);
+        return result < 0 ? 2 : 0;
+    }
+
+    /* pattern and archive, then optional member names */
+    if (args.nfiles < 2) {
+        show_usage(MZIP_GREP);
+        free(args.files);
+        return 2;
+    }
+    if (!*args.files[0]) {
+        fprintf(stderr, "Error: empty pattern\n");
+        free(args.files);
+        return 2;
+    }
+
+    result = grep_archive(args.files[0], args.files[1], args.files + 2,
+                          args.nfiles - 2, &args);
+    free(args.files);
+    return result < 0 ? 2 : result;
 }
 
 /* Busybox-style entry */
@@ -625,6 +3424,8 @@ int main(int argc, char **argv)
         !strcmp(progname, "munzip")) {
         return decompress(argc, argv);
     }
+    if (strstr(progname, "grep"))
+        return grep(argc, argv);
 
     /* Default to compression mode */
     return compress(argc, argv);